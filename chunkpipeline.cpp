@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) 2015 by Glenn Hickey (hickey@soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.cactus
+ */
+
+#include <cassert>
+#include <stdexcept>
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
+#include "chunkpipeline.h"
+
+using namespace std;
+using namespace vg;
+using namespace google::protobuf;
+using namespace google::protobuf::io;
+
+ChunkPipeline::ChunkPipeline(size_t numThreads) :
+  _pushed(0), _parsed(0), _popped(0), _holding(false), _closed(false),
+  _cancelled(false)
+{
+  if (numThreads == 0)
+  {
+    numThreads = 1;
+  }
+  // a couple of chunks per worker is enough to keep everyone busy
+  _slots.resize(2 * numThreads + 2);
+  for (size_t i = 0; i < _slots.size(); ++i)
+  {
+    _slots[i]._state = Empty;
+    _slots[i]._data = NULL;
+    _slots[i]._size = 0;
+    _slots[i]._arena = new Arena();
+    _slots[i]._graph = NULL;
+  }
+  for (size_t i = 0; i < numThreads; ++i)
+  {
+    _workers.push_back(thread(&ChunkPipeline::parseWorker, this));
+  }
+}
+
+ChunkPipeline::~ChunkPipeline()
+{
+  cancel();
+  for (size_t i = 0; i < _workers.size(); ++i)
+  {
+    _workers[i].join();
+  }
+  for (size_t i = 0; i < _slots.size(); ++i)
+  {
+    delete _slots[i]._arena;
+  }
+}
+
+bool ChunkPipeline::push(string& bytes)
+{
+  unique_lock<mutex> lock(_mutex);
+  Slot* slot = waitForEmptySlot(lock);
+  if (slot == NULL)
+  {
+    return false;
+  }
+  slot->_bytes.swap(bytes);
+  slot->_data = slot->_bytes.data();
+  slot->_size = slot->_bytes.length();
+  slot->_state = Raw;
+  ++_pushed;
+  _cond.notify_all();
+  return true;
+}
+
+bool ChunkPipeline::push(const char* data, size_t size)
+{
+  unique_lock<mutex> lock(_mutex);
+  Slot* slot = waitForEmptySlot(lock);
+  if (slot == NULL)
+  {
+    return false;
+  }
+  slot->_data = data;
+  slot->_size = size;
+  slot->_state = Raw;
+  ++_pushed;
+  _cond.notify_all();
+  return true;
+}
+
+ChunkPipeline::Slot* ChunkPipeline::waitForEmptySlot(unique_lock<mutex>& lock)
+{
+  while (!_cancelled && _pushed - _popped >= _slots.size())
+  {
+    _cond.wait(lock);
+  }
+  if (_cancelled)
+  {
+    return NULL;
+  }
+  Slot* slot = &getSlot(_pushed);
+  assert(slot->_state == Empty);
+  return slot;
+}
+
+void ChunkPipeline::close()
+{
+  lock_guard<mutex> lock(_mutex);
+  _closed = true;
+  _cond.notify_all();
+}
+
+void ChunkPipeline::fail(exception_ptr error)
+{
+  lock_guard<mutex> lock(_mutex);
+  _error = error;
+  _closed = true;
+  _cond.notify_all();
+}
+
+const GraphDecoder* ChunkPipeline::pop()
+{
+  unique_lock<mutex> lock(_mutex);
+  if (_holding)
+  {
+    // consumer is done with the last chunk, so its slot can be reused
+    getSlot(_popped)._state = Empty;
+    ++_popped;
+    _holding = false;
+    _cond.notify_all();
+  }
+  while (!_cancelled && !(_popped < _pushed &&
+                          getSlot(_popped)._state == Parsed) &&
+         !(_closed && (_error || _popped == _pushed)))
+  {
+    _cond.wait(lock);
+  }
+  if (_error)
+  {
+    rethrow_exception(_error);
+  }
+  if (_cancelled || _popped == _pushed)
+  {
+    return NULL;
+  }
+  _holding = true;
+  if (getSlot(_popped)._error)
+  {
+    rethrow_exception(getSlot(_popped)._error);
+  }
+  return &getSlot(_popped)._decoded;
+}
+
+void ChunkPipeline::cancel()
+{
+  lock_guard<mutex> lock(_mutex);
+  _cancelled = true;
+  _cond.notify_all();
+}
+
+void ChunkPipeline::parseWorker()
+{
+  unique_lock<mutex> lock(_mutex);
+  while (true)
+  {
+    while (!_cancelled && _parsed == _pushed && !_closed)
+    {
+      _cond.wait(lock);
+    }
+    if (_cancelled || _parsed == _pushed)
+    {
+      break;
+    }
+    Slot& slot = getSlot(_parsed++);
+    assert(slot._state == Raw);
+    slot._state = Parsing;
+    lock.unlock();
+
+    // decode straight out of the buffer, whether it's ours or mapped.
+    // the fallback parses into a fresh arena (freeing the last chunk
+    // parsed in this slot).  errors are kept for the consumer
+    slot._arena->Reset();
+    slot._graph = NULL;
+    slot._error = exception_ptr();
+    try
+    {
+      if (!slot._decoded.decode(slot._data, slot._size))
+      {
+        slot._graph = Arena::CreateMessage<Graph>(slot._arena);
+        ArrayInputStream arrayStream(slot._data, slot._size);
+        if (!slot._graph->ParseFromZeroCopyStream(&arrayStream))
+        {
+          throw runtime_error("Error parsing graph chunk");
+        }
+        slot._decoded.load(*slot._graph);
+      }
+    }
+    catch(...)
+    {
+      slot._error = current_exception();
+    }
+
+    lock.lock();
+    slot._state = Parsed;
+    _cond.notify_all();
+  }
+}
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2015 by Glenn Hickey (hickey@soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.cactus
+ */
+
+#ifndef _CHUNKPIPELINE_H
+#define _CHUNKPIPELINE_H
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include "google/protobuf/arena.h"
+#include "vg.pb.h"
+#include "graphdecoder.h"
+
+/*
+ * Parse serialized vg::Graph chunks on a pool of worker threads.  One
+ * thread (the reader) pushes raw message bytes in, the workers parse
+ * them in whatever order they get to them, and a single consumer pops
+ * the parsed graphs back out in exactly the order they were pushed.
+ * At most a fixed window of chunks is ever in flight so memory stays
+ * bounded no matter how far the reader gets ahead.
+ *
+ * Chunks are decoded with GraphDecoder, which only pulls out the
+ * fields we use.  If it can't handle a chunk, the generated parser is
+ * used instead, into an arena owned by the slot so that parsing
+ * doesn't go to the heap for every message and string, and the whole
+ * chunk is freed at once when the slot is reused.  A chunk that neither
+ * can parse (or any other error while parsing it) is rethrown by pop()
+ * when its turn comes.
+ */
+class ChunkPipeline
+{
+public:
+   ChunkPipeline(size_t numThreads);
+   ~ChunkPipeline();
+
+   /** Reader side: queue up a serialized Graph.  The bytes are swapped
+    * out of the argument.  Blocks while the window is full.  Returns
+    * false if the pipeline was cancelled. */
+   bool push(std::string& bytes);
+
+   /** Reader side: queue up a serialized Graph that lives in memory 
+    * we don't own (ie a mapped file).  It is parsed in place, and the
+    * decoded chunk points into it, so it must stay valid until the
+    * consumer is done with the chunk. */
+   bool push(const char* data, size_t size);
+
+   /** Reader side: no more chunks are coming */
+   void close();
+
+   /** Reader side: stop with an error, which is rethrown from pop() */
+   void fail(std::exception_ptr error);
+
+   /** Consumer side: get the next chunk in input order.  It belongs to
+    * the pipeline and is only valid until the next call.  Returns NULL
+    * once every pushed chunk has been popped and close() was called.
+    * Throws the error if the chunk couldn't be parsed */
+   const GraphDecoder* pop();
+
+   /** Consumer side: give up early, unblocking the reader and workers */
+   void cancel();
+
+protected:
+
+   enum SlotState { Empty, Raw, Parsing, Parsed };
+   struct Slot {
+      SlotState _state;
+      std::string _bytes;
+      const char* _data;
+      size_t _size;
+      GraphDecoder _decoded;
+      google::protobuf::Arena* _arena;
+      vg::Graph* _graph;
+      /** set if parsing failed */
+      std::exception_ptr _error;
+   };
+
+   void parseWorker();
+   Slot& getSlot(size_t index);
+   /** wait for room in the window and return slot to fill (or NULL
+    * if cancelled).  must be called with _mutex held */
+   Slot* waitForEmptySlot(std::unique_lock<std::mutex>& lock);
+
+   std::vector<Slot> _slots;
+   std::vector<std::thread> _workers;
+   std::mutex _mutex;
+   std::condition_variable _cond;
+   /** next index to be pushed, parsed and popped, respectively */
+   size_t _pushed;
+   size_t _parsed;
+   size_t _popped;
+   /** consumer still has the chunk at _popped */
+   bool _holding;
+   bool _closed;
+   bool _cancelled;
+   std::exception_ptr _error;
+};
+
+inline ChunkPipeline::Slot& ChunkPipeline::getSlot(size_t index)
+{
+  return _slots[index % _slots.size()];
+}
+
+#endif
@@ -0,0 +1,276 @@
+/*
+ * Copyright (C) 2015 by Glenn Hickey (hickey@soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.cactus
+ */
+
+#include <cstring>
+#include <sstream>
+#include "gfareader.h"
+
+using namespace std;
+using namespace vg;
+
+bool GFAReader::isGFAPath(const string& path)
+{
+  size_t dot = path.rfind('.');
+  if (dot == string::npos)
+  {
+    return false;
+  }
+  string extension = path.substr(dot + 1);
+  return extension == "gfa" || extension == "GFA";
+}
+
+void GFAReader::splitBlocks(const char* data, size_t size, size_t blockSize,
+                            vector<pair<const char*, const char*> >& blocks)
+{
+  blocks.clear();
+  const char* end = data + size;
+  for (const char* begin = data; begin < end;)
+  {
+    const char* blockEnd = begin + min(blockSize, (size_t)(end - begin));
+    if (blockEnd < end)
+    {
+      // extend to the end of the line we landed in
+      const char* newline = (const char*)memchr(blockEnd, '\n',
+                                                end - blockEnd);
+      blockEnd = newline != NULL ? newline + 1 : end;
+    }
+    blocks.push_back(pair<const char*, const char*>(begin, blockEnd));
+    begin = blockEnd;
+  }
+}
+
+void GFAReader::parseBlock(const char* begin, const char* end,
+                           const PathFilter* filter, Graph& graph)
+{
+  vector<Field> fields;
+  while (begin < end)
+  {
+    const char* lineEnd = (const char*)memchr(begin, '\n', end - begin);
+    if (lineEnd == NULL)
+    {
+      lineEnd = end;
+    }
+    Field line(begin, lineEnd);
+    if (line.second > line.first && *(line.second - 1) == '\r')
+    {
+      --line.second;
+    }
+    if (line.second > line.first)
+    {
+      switch (*line.first)
+      {
+      case 'S':
+        splitFields(line.first, line.second, fields);
+        parseSegment(fields, line, graph);
+        break;
+      case 'L':
+        splitFields(line.first, line.second, fields);
+        parseLink(fields, line, graph);
+        break;
+      case 'P':
+        splitFields(line.first, line.second, fields);
+        parsePath(fields, line, filter, graph);
+        break;
+      case 'W':
+        splitFields(line.first, line.second, fields);
+        parseWalk(fields, line, filter, graph);
+        break;
+      default:
+        break;
+      }
+    }
+    begin = lineEnd + 1;
+  }
+}
+
+void GFAReader::splitFields(const char* begin, const char* end,
+                            vector<Field>& fields)
+{
+  fields.clear();
+  while (true)
+  {
+    const char* tab = (const char*)memchr(begin, '\t', end - begin);
+    if (tab == NULL)
+    {
+      fields.push_back(Field(begin, end));
+      break;
+    }
+    fields.push_back(Field(begin, tab));
+    begin = tab + 1;
+  }
+}
+
+runtime_error GFAReader::lineError(const string& msg, const Field& line)
+{
+  // don't want to print a whole chromosome
+  size_t length = min((size_t)(line.second - line.first), (size_t)100);
+  stringstream ss;
+  ss << msg << " in GFA line: " << string(line.first, length);
+  if (length < line.second - line.first)
+  {
+    ss << "...";
+  }
+  return runtime_error(ss.str());
+}
+
+int64_t GFAReader::parseID(const Field& field, const Field& line)
+{
+  int64_t id = 0;
+  const char* pos = field.first;
+  bool negative = pos < field.second && *pos == '-';
+  if (negative)
+  {
+    ++pos;
+  }
+  if (pos == field.second)
+  {
+    throw lineError("Missing node id", line);
+  }
+  for (; pos < field.second; ++pos)
+  {
+    if (*pos < '0' || *pos > '9')
+    {
+      throw lineError("Segment name " + string(field.first, field.second) +
+                      " is not a numeric id", line);
+    }
+    id = id * 10 + (*pos - '0');
+  }
+  return negative ? -id : id;
+}
+
+bool GFAReader::parseOrientation(const Field& field, const Field& line)
+{
+  if (field.second - field.first != 1 ||
+      (*field.first != '+' && *field.first != '-'))
+  {
+    throw lineError("Invalid orientation", line);
+  }
+  return *field.first == '-';
+}
+
+void GFAReader::parseSegment(const vector<Field>& fields, const Field& line,
+                             Graph& graph)
+{
+  if (fields.size() < 3)
+  {
+    throw lineError("Too few fields", line);
+  }
+  if (fields[2].second - fields[2].first == 1 && *fields[2].first == '*')
+  {
+    throw lineError("Missing sequence", line);
+  }
+  Node* node = graph.add_node();
+  node->set_id(parseID(fields[1], line));
+  node->set_sequence(fields[2].first, fields[2].second - fields[2].first);
+}
+
+void GFAReader::parseLink(const vector<Field>& fields, const Field& line,
+                          Graph& graph)
+{
+  if (fields.size() < 5)
+  {
+    throw lineError("Too few fields", line);
+  }
+  if (fields.size() > 5)
+  {
+    string overlap(fields[5].first, fields[5].second);
+    if (overlap != "*" && overlap != "0M" && !overlap.empty())
+    {
+      throw lineError("Overlap " + overlap + " not supported", line);
+    }
+  }
+  Edge* edge = graph.add_edge();
+  edge->set_from(parseID(fields[1], line));
+  edge->set_from_start(parseOrientation(fields[2], line));
+  edge->set_to(parseID(fields[3], line));
+  edge->set_to_end(parseOrientation(fields[4], line));
+}
+
+void GFAReader::parsePath(const vector<Field>& fields, const Field& line,
+                          const PathFilter* filter, Graph& graph)
+{
+  if (fields.size() < 3)
+  {
+    throw lineError("Too few fields", line);
+  }
+  string name(fields[1].first, fields[1].second);
+  if (filter != NULL && !filter->matches(name))
+  {
+    return;
+  }
+  Path* path = graph.add_path();
+  path->set_name(name);
+  // comma separated list of ids with orientation: 1+,2-,3+
+  const char* end = fields[2].second;
+  for (const char* pos = fields[2].first; pos < end;)
+  {
+    const char* comma = (const char*)memchr(pos, ',', end - pos);
+    if (comma == NULL)
+    {
+      comma = end;
+    }
+    if (comma - pos < 2)
+    {
+      throw lineError("Invalid path step", line);
+    }
+    Mapping* mapping = path->add_mapping();
+    mapping->set_rank(path->mapping_size());
+    Position* position = mapping->mutable_position();
+    position->set_node_id(parseID(Field(pos, comma - 1), line));
+    position->set_is_reverse(parseOrientation(Field(comma - 1, comma), line));
+    pos = comma + 1;
+  }
+}
+
+void GFAReader::parseWalk(const vector<Field>& fields, const Field& line,
+                          const PathFilter* filter, Graph& graph)
+{
+  if (fields.size() < 7)
+  {
+    throw lineError("Too few fields", line);
+  }
+  string name = string(fields[1].first, fields[1].second) + "#" +
+     string(fields[2].first, fields[2].second) + "#" +
+     string(fields[3].first, fields[3].second);
+  // a haplotype can be split over several walks, which each need
+  // their own name
+  string start(fields[4].first, fields[4].second);
+  if (start != "0" && start != "*")
+  {
+    name += ":" + start + "-" + string(fields[5].first, fields[5].second);
+  }
+  if (filter != NULL && !filter->matches(name))
+  {
+    return;
+  }
+  // ids each prefixed by orientation: >1<2>3
+  const char* end = fields[6].second;
+  const char* pos = fields[6].first;
+  if (pos < end && *pos == '*')
+  {
+    return;
+  }
+  Path* path = graph.add_path();
+  path->set_name(name);
+  while (pos < end)
+  {
+    if (*pos != '>' && *pos != '<')
+    {
+      throw lineError("Invalid walk step", line);
+    }
+    const char* next = pos + 1;
+    while (next < end && *next != '>' && *next != '<')
+    {
+      ++next;
+    }
+    Mapping* mapping = path->add_mapping();
+    mapping->set_rank(path->mapping_size());
+    Position* position = mapping->mutable_position();
+    position->set_node_id(parseID(Field(pos + 1, next), line));
+    position->set_is_reverse(*pos == '<');
+    pos = next;
+  }
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2015 by Glenn Hickey (hickey@soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.cactus
+ */
+
+#ifndef _GFAREADER_H
+#define _GFAREADER_H
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <stdexcept>
+#include "vg.pb.h"
+#include "pathfilter.h"
+
+/*
+ * Parse GFA (v1, plus W lines from v1.1) text into VG Graph messages, so
+ * it can be loaded exactly like a protobuf chunk.  The text is split
+ * into blocks of whole lines that can be parsed independently (in
+ * parallel):
+ *   S lines become nodes.  Segment names must be numeric ids.
+ *   L lines become edges.  Overlaps must be empty (* or 0M).
+ *   P lines become paths, with one full-node mapping per step.
+ *   W lines become paths named sample#haplotype#sequence, plus
+ *     :start-end if they don't start at 0 (so the pieces of a
+ *     fragmented haplotype stay apart).
+ * Each P or W line must have a different name.
+ * Everything else is ignored.
+ */
+class GFAReader
+{
+public:
+
+   /** does the file name look like GFA (.gfa extension) */
+   static bool isGFAPath(const std::string& path);
+
+   /** split text into blocks of roughly blockSize bytes that end at line
+    * boundaries */
+   static void splitBlocks(
+     const char* data, size_t size, size_t blockSize,
+     std::vector<std::pair<const char*, const char*> >& blocks);
+
+   /** parse all the lines in [begin, end) into graph.  Paths that don't
+    * pass filter (if not NULL) are skipped.  Throws runtime_error if a
+    * line can't be parsed */
+   static void parseBlock(const char* begin, const char* end,
+                          const PathFilter* filter, vg::Graph& graph);
+
+protected:
+
+   typedef std::pair<const char*, const char*> Field;
+
+   /** split a line into tab separated fields */
+   static void splitFields(const char* begin, const char* end,
+                           std::vector<Field>& fields);
+   static int64_t parseID(const Field& field, const Field& line);
+   static bool parseOrientation(const Field& field, const Field& line);
+   /** error to throw for a bad line */
+   static std::runtime_error lineError(const std::string& msg,
+                                       const Field& line);
+
+   static void parseSegment(const std::vector<Field>& fields,
+                            const Field& line, vg::Graph& graph);
+   static void parseLink(const std::vector<Field>& fields,
+                         const Field& line, vg::Graph& graph);
+   static void parsePath(const std::vector<Field>& fields,
+                         const Field& line, const PathFilter* filter,
+                         vg::Graph& graph);
+   static void parseWalk(const std::vector<Field>& fields,
+                         const Field& line, const PathFilter* filter,
+                         vg::Graph& graph);
+};
+
+#endif
@@ -0,0 +1,483 @@
+/*
+ * Copyright (C) 2015 by Glenn Hickey (hickey@soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.cactus
+ */
+
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "graphcache.h"
+#include "mappedfile.h"
+
+using namespace std;
+using namespace vg;
+
+static const char cacheMagic[8] = {'V', 'G', '2', 'S', 'G', 'C', 'C', 'H'};
+// bump whenever the layout (or anything in it, like PathStep) changes
+static const uint64_t cacheVersion = 1;
+
+/** how much of the input gets hashed for the key */
+static const size_t hashBlockSize = 1 << 16;
+static const size_t hashBlocks = 16;
+
+string GraphCache::getCachePath(const string& inputPath)
+{
+  return inputPath + ".vg2sg";
+}
+
+bool GraphCache::getInputKey(const string& inputPath, Header& header)
+{
+  int fd = open(inputPath.c_str(), O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0)
+  {
+    if (fd >= 0)
+    {
+      close(fd);
+    }
+    return false;
+  }
+  header._inputSize = st.st_size;
+  header._inputMTime = st.st_mtim.tv_sec;
+  header._inputMTimeNS = st.st_mtim.tv_nsec;
+
+  // FNV-1a hash of blocks spread evenly over the file (always including
+  // the first and last), which is plenty to go with the size and mtime
+  // and doesn't mean reading the whole thing
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  vector<unsigned char> buffer(hashBlockSize);
+  uint64_t size = header._inputSize;
+  uint64_t stride = size > hashBlockSize ?
+     (size - hashBlockSize) / (hashBlocks - 1) : 0;
+  for (size_t i = 0; i < hashBlocks && (i == 0 || stride > 0); ++i)
+  {
+    ssize_t bytes = pread(fd, &buffer[0], hashBlockSize, i * stride);
+    if (bytes < 0)
+    {
+      close(fd);
+      return false;
+    }
+    for (ssize_t j = 0; j < bytes; ++j)
+    {
+      hash = (hash ^ buffer[j]) * 0x100000001b3ULL;
+    }
+  }
+  close(fd);
+  header._inputHash = hash;
+  return true;
+}
+
+/** array to write to the cache */
+struct SectionData
+{
+   SectionData() : _data(0), _count(0), _size(0) {}
+   template<typename T> void set(const vector<T>& v) {
+     _data = v.data(); _count = v.size(); _size = sizeof(T);
+   }
+   const void* _data;
+   uint64_t _count;
+   uint64_t _size;
+};
+
+/** write all of a buffer to a file, returning false on error */
+static bool writeAll(int fd, const void* data, size_t size)
+{
+  const char* pos = (const char*)data;
+  while (size > 0)
+  {
+    ssize_t bytes = write(fd, pos, size);
+    if (bytes < 0 && errno != EINTR)
+    {
+      return false;
+    }
+    if (bytes > 0)
+    {
+      pos += bytes;
+      size -= bytes;
+    }
+  }
+  return true;
+}
+
+/** build offset and text arrays for a list of strings */
+static void addString(const string& s, vector<uint64_t>& offsets,
+                      vector<char>& text)
+{
+  if (offsets.empty())
+  {
+    offsets.push_back(0);
+  }
+  text.insert(text.end(), s.begin(), s.end());
+  offsets.push_back(text.size());
+}
+
+void GraphCache::save(const VGLight& vg, const string& cachePath,
+                      const string& inputPath)
+{
+  if (vg.hasPathFilter())
+  {
+    throw runtime_error("Can't cache a graph loaded with a path filter");
+  }
+  if (vg.hasCompactIDs())
+  {
+    throw runtime_error("Can't cache a graph whose nodes were renumbered");
+  }
+  Header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header._magic, cacheMagic, sizeof(cacheMagic));
+  header._version = cacheVersion;
+  if (!getInputKey(inputPath, header))
+  {
+    throw runtime_error("Error reading " + inputPath);
+  }
+  header._numEdges = vg._numEdges;
+
+  const NodeTable& nodeTable = vg._nodes;
+  vector<int64_t> nodeIDs(nodeTable.size());
+  vector<uint64_t> seqOffsets(1, 0);
+  vector<char> sequences;
+  for (size_t i = 0; i < nodeTable.size(); ++i)
+  {
+    nodeIDs[i] = nodeTable.getNode(i).id();
+    size_t length = nodeTable.getLength(i);
+    sequences.resize(sequences.size() + length);
+    if (length > 0)
+    {
+      nodeTable.getSequence(i, 0, length, &sequences[seqOffsets.back()]);
+    }
+    seqOffsets.push_back(sequences.size());
+  }
+
+  vector<CacheEdge> edges(vg._edges.size());
+  for (size_t i = 0; i < edges.size(); ++i)
+  {
+    const Edge& edge = vg._edges[i];
+    edges[i]._from = edge.from();
+    edges[i]._to = edge.to();
+    edges[i]._fromStart = edge.from_start();
+    edges[i]._toEnd = edge.to_end();
+  }
+  // adjacency stored as positions in the edge array
+  const Edge* firstEdge = vg._edges.data();
+  vector<uint64_t> outOffsets(vg._outOffsets.begin(), vg._outOffsets.end());
+  vector<uint64_t> outEdges(vg._outEdges.size());
+  for (size_t i = 0; i < outEdges.size(); ++i)
+  {
+    outEdges[i] = vg._outEdges[i] - firstEdge;
+  }
+  vector<uint64_t> inOffsets(vg._inOffsets.begin(), vg._inOffsets.end());
+  vector<uint64_t> inEdges(vg._inEdges.size());
+  for (size_t i = 0; i < inEdges.size(); ++i)
+  {
+    inEdges[i] = vg._inEdges[i] - firstEdge;
+  }
+
+  vector<uint64_t> pathNameOffsets;
+  vector<char> pathNames;
+  vector<uint64_t> stepOffsets(1, 0);
+  vector<VGLight::PathStep> steps;
+  for (VGLight::PathMap::const_iterator i = vg._paths.begin();
+       i != vg._paths.end(); ++i)
+  {
+    addString(i->first, pathNameOffsets, pathNames);
+    steps.insert(steps.end(), i->second.begin(), i->second.end());
+    stepOffsets.push_back(steps.size());
+  }
+
+  vector<uint64_t> errorNameOffsets;
+  vector<char> errorNames;
+  vector<int64_t> errorRanks;
+  vector<uint64_t> errorTextOffsets;
+  vector<char> errorText;
+  for (map<string, pair<int64_t, string> >::const_iterator i =
+          vg._pathErrors.begin(); i != vg._pathErrors.end(); ++i)
+  {
+    addString(i->first, errorNameOffsets, errorNames);
+    errorRanks.push_back(i->second.first);
+    addString(i->second.second, errorTextOffsets, errorText);
+  }
+
+  SectionData sections[NumSections];
+  sections[NodeIDs].set(nodeIDs);
+  sections[SequenceOffsets].set(seqOffsets);
+  sections[Sequences].set(sequences);
+  sections[Edges].set(edges);
+  sections[OutOffsets].set(outOffsets);
+  sections[OutEdges].set(outEdges);
+  sections[InOffsets].set(inOffsets);
+  sections[InEdges].set(inEdges);
+  sections[PathNameOffsets].set(pathNameOffsets);
+  sections[PathNames].set(pathNames);
+  sections[PathStepOffsets].set(stepOffsets);
+  sections[PathSteps].set(steps);
+  sections[ErrorNameOffsets].set(errorNameOffsets);
+  sections[ErrorNames].set(errorNames);
+  sections[ErrorRanks].set(errorRanks);
+  sections[ErrorTextOffsets].set(errorTextOffsets);
+  sections[ErrorText].set(errorText);
+  uint64_t offset = sizeof(Header);
+  for (int i = 0; i < NumSections; ++i)
+  {
+    header._offsets[i] = offset;
+    header._counts[i] = sections[i]._count;
+    offset += (sections[i]._count * sections[i]._size + 7) & ~7ULL;
+  }
+
+  // write to a temporary file (with a unique name, as several runs on
+  // the same input may be saving at once) and move it into place once
+  // it's on disk, so a cache that gets read is always complete
+  string tempPath = cachePath + ".XXXXXX";
+  int fd = mkstemp(&tempPath[0]);
+  if (fd < 0)
+  {
+    throw runtime_error("Error opening " + tempPath);
+  }
+  const char padding[8] = {0};
+  bool ok = fchmod(fd, 0644) == 0 &&
+     writeAll(fd, &header, sizeof(header));
+  for (int i = 0; i < NumSections && ok; ++i)
+  {
+    uint64_t bytes = sections[i]._count * sections[i]._size;
+    ok = writeAll(fd, sections[i]._data, bytes) &&
+       writeAll(fd, padding, ((bytes + 7) & ~7ULL) - bytes);
+  }
+  ok = fsync(fd) == 0 && ok;
+  ok = close(fd) == 0 && ok;
+  if (!ok || rename(tempPath.c_str(), cachePath.c_str()) != 0)
+  {
+    remove(tempPath.c_str());
+    throw runtime_error("Error writing " + cachePath);
+  }
+}
+
+/** is an array of count offsets into an array of size elements valid:
+ * starting at 0 and never going down or past the end */
+static bool checkOffsets(const uint64_t* offsets, uint64_t count,
+                         uint64_t size)
+{
+  if (count == 0)
+  {
+    return true;
+  }
+  if (offsets[0] != 0 || offsets[count - 1] > size)
+  {
+    return false;
+  }
+  for (uint64_t i = 1; i < count; ++i)
+  {
+    if (offsets[i] < offsets[i - 1])
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool GraphCache::load(VGLight& vg, const string& cachePath,
+                      const string& inputPath)
+{
+  vg.clear();
+  Header key;
+  struct stat st;
+  if (stat(cachePath.c_str(), &st) != 0 || !getInputKey(inputPath, key))
+  {
+    return false;
+  }
+  // a cache that can't be read is just a miss
+  MappedFile file;
+  try
+  {
+    file.open(cachePath);
+  }
+  catch(runtime_error& e)
+  {
+    return false;
+  }
+  const char* data = file.getData();
+  if (file.getSize() < sizeof(Header))
+  {
+    return false;
+  }
+  Header header;
+  memcpy(&header, data, sizeof(Header));
+  if (memcmp(header._magic, cacheMagic, sizeof(cacheMagic)) != 0 ||
+      header._version != cacheVersion ||
+      header._inputSize != key._inputSize ||
+      header._inputMTime != key._inputMTime ||
+      header._inputMTimeNS != key._inputMTimeNS ||
+      header._inputHash != key._inputHash)
+  {
+    return false;
+  }
+  const size_t sizes[NumSections] = {
+    sizeof(int64_t), sizeof(uint64_t), sizeof(char), sizeof(CacheEdge),
+    sizeof(uint64_t), sizeof(uint64_t), sizeof(uint64_t), sizeof(uint64_t),
+    sizeof(uint64_t), sizeof(char), sizeof(uint64_t),
+    sizeof(VGLight::PathStep), sizeof(uint64_t), sizeof(char),
+    sizeof(int64_t), sizeof(uint64_t), sizeof(char)};
+  for (int i = 0; i < NumSections; ++i)
+  {
+    if (header._offsets[i] % 8 != 0 || header._offsets[i] > file.getSize() ||
+        header._counts[i] > (file.getSize() - header._offsets[i]) / sizes[i])
+    {
+      return false;
+    }
+  }
+  // the string and offset arrays need to agree with each other
+  const uint64_t* counts = header._counts;
+  uint64_t numNodes = counts[NodeIDs];
+  uint64_t numErrors = counts[ErrorRanks];
+  if (counts[SequenceOffsets] != numNodes + 1 ||
+      counts[PathStepOffsets] < 1 ||
+      counts[PathNameOffsets] != (counts[PathStepOffsets] == 1 ? 0 :
+                                  counts[PathStepOffsets]) ||
+      counts[ErrorNameOffsets] != (numErrors == 0 ? 0 : numErrors + 1) ||
+      counts[ErrorTextOffsets] != counts[ErrorNameOffsets] ||
+      counts[OutOffsets] != numNodes + 1 ||
+      counts[InOffsets] != numNodes + 1 ||
+      header._numEdges != counts[Edges])
+  {
+    return false;
+  }
+  const int64_t* nodeIDs = (const int64_t*)(data + header._offsets[NodeIDs]);
+  const uint64_t* seqOffsets =
+     (const uint64_t*)(data + header._offsets[SequenceOffsets]);
+  const char* sequences = data + header._offsets[Sequences];
+  const CacheEdge* edges = (const CacheEdge*)(data + header._offsets[Edges]);
+  const uint64_t* outEdges =
+     (const uint64_t*)(data + header._offsets[OutEdges]);
+  const uint64_t* inEdges = (const uint64_t*)(data + header._offsets[InEdges]);
+  const uint64_t* outOffsets =
+     (const uint64_t*)(data + header._offsets[OutOffsets]);
+  const uint64_t* inOffsets =
+     (const uint64_t*)(data + header._offsets[InOffsets]);
+  const uint64_t* pathNameOffsets =
+     (const uint64_t*)(data + header._offsets[PathNameOffsets]);
+  const char* pathNames = data + header._offsets[PathNames];
+  const uint64_t* stepOffsets =
+     (const uint64_t*)(data + header._offsets[PathStepOffsets]);
+  const VGLight::PathStep* steps =
+     (const VGLight::PathStep*)(data + header._offsets[PathSteps]);
+  const uint64_t* errorNameOffsets =
+     (const uint64_t*)(data + header._offsets[ErrorNameOffsets]);
+  const char* errorNames = data + header._offsets[ErrorNames];
+  const int64_t* errorRanks =
+     (const int64_t*)(data + header._offsets[ErrorRanks]);
+  const uint64_t* errorTextOffsets =
+     (const uint64_t*)(data + header._offsets[ErrorTextOffsets]);
+  const char* errorText = data + header._offsets[ErrorText];
+
+  // check everything that gets indexed by something else, so a
+  // damaged cache is never more than a cache miss
+  if (!checkOffsets(seqOffsets, counts[SequenceOffsets], counts[Sequences]) ||
+      !checkOffsets(outOffsets, counts[OutOffsets], counts[OutEdges]) ||
+      outOffsets[numNodes] != counts[OutEdges] ||
+      !checkOffsets(inOffsets, counts[InOffsets], counts[InEdges]) ||
+      inOffsets[numNodes] != counts[InEdges] ||
+      !checkOffsets(pathNameOffsets, counts[PathNameOffsets],
+                    counts[PathNames]) ||
+      !checkOffsets(stepOffsets, counts[PathStepOffsets], counts[PathSteps]) ||
+      !checkOffsets(errorNameOffsets, counts[ErrorNameOffsets],
+                    counts[ErrorNames]) ||
+      !checkOffsets(errorTextOffsets, counts[ErrorTextOffsets],
+                    counts[ErrorText]))
+  {
+    return false;
+  }
+  // (sorted and unique, so the node table keeps them all in place)
+  for (uint64_t i = 1; i < numNodes; ++i)
+  {
+    if (nodeIDs[i] <= nodeIDs[i - 1])
+    {
+      return false;
+    }
+  }
+  for (uint64_t i = 0; i < counts[PathSteps]; ++i)
+  {
+    if (steps[i]._node >= numNodes)
+    {
+      return false;
+    }
+  }
+  for (uint64_t i = 0; i < counts[OutEdges]; ++i)
+  {
+    if (outEdges[i] >= counts[Edges])
+    {
+      return false;
+    }
+  }
+  for (uint64_t i = 0; i < counts[InEdges]; ++i)
+  {
+    if (inEdges[i] >= counts[Edges])
+    {
+      return false;
+    }
+  }
+  
+  // nodes are already sorted and unique, so indexing is just building
+  // the id lookup
+  for (uint64_t i = 0; i < numNodes; ++i)
+  {
+    vg._nodes.addNode(nodeIDs[i],
+                      string(sequences + seqOffsets[i],
+                             seqOffsets[i + 1] - seqOffsets[i]));
+  }
+  vg._nodes.index();
+
+  uint64_t numEdges = header._counts[Edges];
+  vg._edges.resize(numEdges);
+  for (uint64_t i = 0; i < numEdges; ++i)
+  {
+    Edge& edge = vg._edges[i];
+    edge.set_from(edges[i]._from);
+    edge.set_to(edges[i]._to);
+    edge.set_from_start(edges[i]._fromStart != 0);
+    edge.set_to_end(edges[i]._toEnd != 0);
+  }
+  vg._numEdges = header._numEdges;
+  vg._outOffsets.assign(outOffsets, outOffsets + header._counts[OutOffsets]);
+  vg._inOffsets.assign(inOffsets, inOffsets + header._counts[InOffsets]);
+  vg._outEdges.resize(header._counts[OutEdges]);
+  for (uint64_t i = 0; i < vg._outEdges.size(); ++i)
+  {
+    vg._outEdges[i] = &vg._edges[outEdges[i]];
+  }
+  vg._inEdges.resize(header._counts[InEdges]);
+  for (uint64_t i = 0; i < vg._inEdges.size(); ++i)
+  {
+    vg._inEdges[i] = &vg._edges[inEdges[i]];
+  }
+  vg.buildEdgeIndex();
+
+  uint64_t numPaths = header._counts[PathStepOffsets] - 1;
+  for (uint64_t i = 0; i < numPaths; ++i)
+  {
+    string name(pathNames + pathNameOffsets[i],
+                pathNameOffsets[i + 1] - pathNameOffsets[i]);
+    if (!vg.passesPathFilter(name))
+    {
+      continue;
+    }
+    vg._paths[name].assign(steps + stepOffsets[i], steps + stepOffsets[i + 1]);
+  }
+  for (uint64_t i = 0; i < header._counts[ErrorRanks]; ++i)
+  {
+    string name(errorNames + errorNameOffsets[i],
+                errorNameOffsets[i + 1] - errorNameOffsets[i]);
+    if (!vg.passesPathFilter(name))
+    {
+      continue;
+    }
+    string text(errorText + errorTextOffsets[i],
+                errorTextOffsets[i + 1] - errorTextOffsets[i]);
+    vg._pathErrors[name] = pair<int64_t, string>(errorRanks[i], text);
+  }
+  return true;
+}
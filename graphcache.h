@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2015 by Glenn Hickey (hickey@soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.cactus
+ */
+
+#ifndef _GRAPHCACHE_H
+#define _GRAPHCACHE_H
+
+#include <string>
+#include <cstdint>
+
+#include "vglight.h"
+
+/*
+ * Binary dump of a loaded VGLight (node table, edge adjacency and
+ * resolved paths) so that it can be read back without decompressing and
+ * parsing the protobuf input again.  The file is a header followed by
+ * flat, 8-byte aligned arrays and is read through a memory map, but
+ * the map is only held while loading: the sequences, edges and path
+ * steps are all copied out of it into the VGLight (the node table and
+ * edges being rebuilt as a Node and an Edge each).  So loading is
+ * still linear in the size of the graph, and a cached graph takes as
+ * much memory as a parsed one, it just skips the decompression and
+ * parsing.  It is tied to the input
+ * it was made from by the input's size, modification time and a hash
+ * of a sample of its contents, and is ignored if any of these change
+ * or if its arrays don't agree with each other.
+ */
+class GraphCache
+{
+public:
+
+   /** default cache file for an input graph */
+   static std::string getCachePath(const std::string& inputPath);
+
+   /** Load a graph from a cache file.  Returns false, leaving vg
+    * empty, if the cache doesn't exist, doesn't match the input or is
+    * damaged.  
+    * Only paths that pass vg's path filter are loaded */
+   static bool load(VGLight& vg, const std::string& cachePath,
+                    const std::string& inputPath);
+
+   /** Write a graph loaded from inputPath to a cache file.  It must
+    * have been loaded without a path filter.  Throws runtime_error if
+    * the cache can't be written */
+   static void save(const VGLight& vg, const std::string& cachePath,
+                    const std::string& inputPath);
+
+protected:
+
+   enum Section {
+      NodeIDs = 0,
+      SequenceOffsets,
+      Sequences,
+      Edges,
+      OutOffsets,
+      OutEdges,
+      InOffsets,
+      InEdges,
+      PathNameOffsets,
+      PathNames,
+      PathStepOffsets,
+      PathSteps,
+      ErrorNameOffsets,
+      ErrorNames,
+      ErrorRanks,
+      ErrorTextOffsets,
+      ErrorText,
+      NumSections
+   };
+
+   struct Header {
+      char _magic[8];
+      uint64_t _version;
+      // input file key
+      uint64_t _inputSize;
+      int64_t _inputMTime;
+      int64_t _inputMTimeNS;
+      uint64_t _inputHash;
+      uint64_t _numEdges;
+      // position in file and number of elements of each array
+      uint64_t _offsets[NumSections];
+      uint64_t _counts[NumSections];
+   };
+
+   struct CacheEdge {
+      int64_t _from;
+      int64_t _to;
+      uint32_t _fromStart;
+      uint32_t _toEnd;
+   };
+
+   /** fill in the input file key of a header, returning false if the
+    * input can't be read */
+   static bool getInputKey(const std::string& inputPath, Header& header);
+};
+
+
+#endif
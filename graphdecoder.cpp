@@ -0,0 +1,484 @@
+/*
+ * Copyright (C) 2015 by Glenn Hickey (hickey@soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.cactus
+ */
+
+#include "graphdecoder.h"
+
+using namespace std;
+using namespace vg;
+
+/** protobuf wire types */
+enum WireType { Varint = 0, Fixed64 = 1, LengthDelimited = 2, Fixed32 = 5 };
+
+GraphDecoder::GraphDecoder()
+{
+}
+
+GraphDecoder::~GraphDecoder()
+{
+}
+
+void GraphDecoder::clear()
+{
+  // keep the capacity: a decoder is reused chunk after chunk
+  _nodes.clear();
+  _edges.clear();
+  _paths.clear();
+  _mappings.clear();
+}
+
+bool GraphDecoder::decode(const char* data, size_t size)
+{
+  clear();
+  const unsigned char* pos = (const unsigned char*)data;
+  const unsigned char* end = pos + size;
+  uint32_t field, wireType;
+  while (pos < end)
+  {
+    if (!readTag(pos, end, field, wireType))
+    {
+      return false;
+    }
+    if (field >= 1 && field <= 3)
+    {
+      const unsigned char* begin;
+      const unsigned char* fieldEnd;
+      if (wireType != LengthDelimited ||
+          !readBytes(pos, end, begin, fieldEnd))
+      {
+        return false;
+      }
+      bool ok = field == 1 ? decodeNode(begin, fieldEnd) :
+         field == 2 ? decodeEdge(begin, fieldEnd) : decodePath(begin, fieldEnd);
+      if (!ok)
+      {
+        return false;
+      }
+    }
+    else if (!skipField(pos, end, wireType))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+void GraphDecoder::load(const Graph& graph)
+{
+  clear();
+  for (size_t i = 0; i < graph.node_size(); ++i)
+  {
+    const Node& node = graph.node(i);
+    NodeRecord record;
+    record._id = node.id();
+    record._sequence = node.sequence().data();
+    record._length = node.sequence().length();
+    _nodes.push_back(record);
+  }
+  for (size_t i = 0; i < graph.edge_size(); ++i)
+  {
+    const Edge& edge = graph.edge(i);
+    EdgeRecord record;
+    record._from = edge.from();
+    record._to = edge.to();
+    record._fromStart = edge.from_start();
+    record._toEnd = edge.to_end();
+    _edges.push_back(record);
+  }
+  for (size_t i = 0; i < graph.path_size(); ++i)
+  {
+    const Path& path = graph.path(i);
+    PathRecord record;
+    record._name = path.name().data();
+    record._nameLength = path.name().length();
+    record._firstMapping = _mappings.size();
+    record._numMappings = path.mapping_size();
+    _paths.push_back(record);
+    for (size_t j = 0; j < path.mapping_size(); ++j)
+    {
+      const Mapping& mapping = path.mapping(j);
+      MappingRecord mappingRecord = MappingRecord();
+      mappingRecord._rank = mapping.rank();
+      mappingRecord._nodeID = mapping.position().node_id();
+      mappingRecord._offset = mapping.position().offset();
+      mappingRecord._reverse = mapping.position().is_reverse();
+      mappingRecord._length = mapping.edit_size() > 0 ? 0 : -1;
+      for (size_t k = 0; k < mapping.edit_size() &&
+              mappingRecord._editError == NoEditError; ++k)
+      {
+        const Edit& edit = mapping.edit(k);
+        if (edit.from_length() != edit.to_length())
+        {
+          mappingRecord._editError = EditLengthMismatch;
+        }
+        else if (edit.sequence().length() > 0)
+        {
+          mappingRecord._editError = EditSequence;
+          mappingRecord._editSequence = edit.sequence().data();
+          mappingRecord._editSequenceLength = edit.sequence().length();
+        }
+        else
+        {
+          mappingRecord._length += edit.from_length();
+        }
+      }
+      _mappings.push_back(mappingRecord);
+    }
+  }
+}
+
+bool GraphDecoder::readVarint(const unsigned char*& pos,
+                              const unsigned char* end, uint64_t& value)
+{
+  value = 0;
+  for (int shift = 0; pos < end && shift < 64; shift += 7)
+  {
+    unsigned char byte = *pos++;
+    value |= (uint64_t)(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool GraphDecoder::readTag(const unsigned char*& pos,
+                           const unsigned char* end,
+                           uint32_t& field, uint32_t& wireType)
+{
+  uint64_t tag;
+  if (!readVarint(pos, end, tag) || (tag >> 3) == 0 || (tag >> 32) != 0)
+  {
+    return false;
+  }
+  field = (uint32_t)(tag >> 3);
+  wireType = (uint32_t)(tag & 7);
+  return true;
+}
+
+bool GraphDecoder::readBytes(const unsigned char*& pos,
+                             const unsigned char* end,
+                             const unsigned char*& begin,
+                             const unsigned char*& fieldEnd)
+{
+  uint64_t length;
+  if (!readVarint(pos, end, length) || length > (uint64_t)(end - pos))
+  {
+    return false;
+  }
+  begin = pos;
+  fieldEnd = pos + length;
+  pos = fieldEnd;
+  return true;
+}
+
+bool GraphDecoder::skipField(const unsigned char*& pos,
+                             const unsigned char* end, uint32_t wireType)
+{
+  uint64_t value;
+  const unsigned char* begin;
+  const unsigned char* fieldEnd;
+  switch (wireType)
+  {
+  case Varint:
+    return readVarint(pos, end, value);
+  case Fixed64:
+    if (end - pos < 8)
+    {
+      return false;
+    }
+    pos += 8;
+    return true;
+  case LengthDelimited:
+    return readBytes(pos, end, begin, fieldEnd);
+  case Fixed32:
+    if (end - pos < 4)
+    {
+      return false;
+    }
+    pos += 4;
+    return true;
+  default:
+    // groups aren't in vg.proto: leave them to the real parser
+    return false;
+  }
+}
+
+bool GraphDecoder::decodeNode(const unsigned char* pos,
+                              const unsigned char* end)
+{
+  NodeRecord node;
+  node._id = 0;
+  node._sequence = NULL;
+  node._length = 0;
+  uint32_t field, wireType;
+  while (pos < end)
+  {
+    if (!readTag(pos, end, field, wireType))
+    {
+      return false;
+    }
+    if (field == 1)
+    {
+      const unsigned char* begin;
+      const unsigned char* fieldEnd;
+      if (wireType != LengthDelimited ||
+          !readBytes(pos, end, begin, fieldEnd))
+      {
+        return false;
+      }
+      node._sequence = (const char*)begin;
+      node._length = fieldEnd - begin;
+    }
+    else if (field == 3)
+    {
+      uint64_t value;
+      if (wireType != Varint || !readVarint(pos, end, value))
+      {
+        return false;
+      }
+      node._id = (int64_t)value;
+    }
+    else if (!skipField(pos, end, wireType))
+    {
+      return false;
+    }
+  }
+  _nodes.push_back(node);
+  return true;
+}
+
+bool GraphDecoder::decodeEdge(const unsigned char* pos,
+                              const unsigned char* end)
+{
+  EdgeRecord edge;
+  edge._from = 0;
+  edge._to = 0;
+  edge._fromStart = false;
+  edge._toEnd = false;
+  uint32_t field, wireType;
+  while (pos < end)
+  {
+    if (!readTag(pos, end, field, wireType))
+    {
+      return false;
+    }
+    if (field >= 1 && field <= 4)
+    {
+      uint64_t value;
+      if (wireType != Varint || !readVarint(pos, end, value))
+      {
+        return false;
+      }
+      switch (field)
+      {
+      case 1: edge._from = (int64_t)value; break;
+      case 2: edge._to = (int64_t)value; break;
+      case 3: edge._fromStart = value != 0; break;
+      default: edge._toEnd = value != 0; break;
+      }
+    }
+    else if (!skipField(pos, end, wireType))
+    {
+      return false;
+    }
+  }
+  _edges.push_back(edge);
+  return true;
+}
+
+bool GraphDecoder::decodePath(const unsigned char* pos,
+                              const unsigned char* end)
+{
+  PathRecord path;
+  path._name = "";
+  path._nameLength = 0;
+  path._firstMapping = _mappings.size();
+  path._numMappings = 0;
+  uint32_t field, wireType;
+  while (pos < end)
+  {
+    if (!readTag(pos, end, field, wireType))
+    {
+      return false;
+    }
+    if (field == 1 || field == 2)
+    {
+      const unsigned char* begin;
+      const unsigned char* fieldEnd;
+      if (wireType != LengthDelimited ||
+          !readBytes(pos, end, begin, fieldEnd))
+      {
+        return false;
+      }
+      if (field == 1)
+      {
+        path._name = (const char*)begin;
+        path._nameLength = fieldEnd - begin;
+      }
+      else
+      {
+        MappingRecord mapping = MappingRecord();
+        mapping._length = -1;
+        if (!decodeMapping(begin, fieldEnd, mapping))
+        {
+          return false;
+        }
+        _mappings.push_back(mapping);
+        ++path._numMappings;
+      }
+    }
+    else if (!skipField(pos, end, wireType))
+    {
+      return false;
+    }
+  }
+  _paths.push_back(path);
+  return true;
+}
+
+bool GraphDecoder::decodeMapping(const unsigned char* pos,
+                                 const unsigned char* end,
+                                 MappingRecord& mapping)
+{
+  uint32_t field, wireType;
+  while (pos < end)
+  {
+    if (!readTag(pos, end, field, wireType))
+    {
+      return false;
+    }
+    if (field == 1 || field == 2)
+    {
+      const unsigned char* begin;
+      const unsigned char* fieldEnd;
+      if (wireType != LengthDelimited ||
+          !readBytes(pos, end, begin, fieldEnd))
+      {
+        return false;
+      }
+      bool ok = field == 1 ? decodePosition(begin, fieldEnd, mapping) :
+         decodeEdit(begin, fieldEnd, mapping);
+      if (!ok)
+      {
+        return false;
+      }
+    }
+    else if (field == 5)
+    {
+      uint64_t value;
+      if (wireType != Varint || !readVarint(pos, end, value))
+      {
+        return false;
+      }
+      mapping._rank = (int64_t)value;
+    }
+    else if (!skipField(pos, end, wireType))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool GraphDecoder::decodePosition(const unsigned char* pos,
+                                  const unsigned char* end,
+                                  MappingRecord& mapping)
+{
+  uint32_t field, wireType;
+  while (pos < end)
+  {
+    if (!readTag(pos, end, field, wireType))
+    {
+      return false;
+    }
+    if (field == 1 || field == 2 || field == 4)
+    {
+      uint64_t value;
+      if (wireType != Varint || !readVarint(pos, end, value))
+      {
+        return false;
+      }
+      switch (field)
+      {
+      case 1: mapping._nodeID = (int64_t)value; break;
+      case 2: mapping._offset = (int64_t)value; break;
+      default: mapping._reverse = value != 0; break;
+      }
+    }
+    else if (!skipField(pos, end, wireType))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool GraphDecoder::decodeEdit(const unsigned char* pos,
+                              const unsigned char* end,
+                              MappingRecord& mapping)
+{
+  int32_t fromLength = 0;
+  int32_t toLength = 0;
+  const unsigned char* sequence = NULL;
+  size_t sequenceLength = 0;
+  uint32_t field, wireType;
+  while (pos < end)
+  {
+    if (!readTag(pos, end, field, wireType))
+    {
+      return false;
+    }
+    if (field == 1 || field == 2)
+    {
+      uint64_t value;
+      if (wireType != Varint || !readVarint(pos, end, value))
+      {
+        return false;
+      }
+      (field == 1 ? fromLength : toLength) = (int32_t)value;
+    }
+    else if (field == 3)
+    {
+      const unsigned char* fieldEnd;
+      if (wireType != LengthDelimited ||
+          !readBytes(pos, end, sequence, fieldEnd))
+      {
+        return false;
+      }
+      sequenceLength = fieldEnd - sequence;
+    }
+    else if (!skipField(pos, end, wireType))
+    {
+      return false;
+    }
+  }
+
+  // same checks as on a parsed Mapping: only the first bad edit counts
+  if (mapping._length < 0)
+  {
+    mapping._length = 0;
+  }
+  if (mapping._editError != NoEditError)
+  {
+    return true;
+  }
+  if (fromLength != toLength)
+  {
+    mapping._editError = EditLengthMismatch;
+  }
+  else if (sequenceLength > 0)
+  {
+    mapping._editError = EditSequence;
+    mapping._editSequence = (const char*)sequence;
+    mapping._editSequenceLength = sequenceLength;
+  }
+  else
+  {
+    mapping._length += fromLength;
+  }
+  return true;
+}
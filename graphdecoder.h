@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2015 by Glenn Hickey (hickey@soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.cactus
+ */
+
+#ifndef _GRAPHDECODER_H
+#define _GRAPHDECODER_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "vg.pb.h"
+
+/*
+ * The parts of a vg::Graph chunk that the conversion uses, decoded
+ * straight off the protobuf wire format into flat record arrays:
+ *   Node: id, sequence
+ *   Edge: from, to, from_start, to_end
+ *   Path: name, and for each mapping its rank, position and what its
+ *         edits add up to
+ * Every other field (names, data, metadata, edit sequences beyond a
+ * check that they're empty) is skipped without being materialized.
+ * Strings are views into the decoded bytes, so those must outlive the
+ * records.
+ *
+ * decode() only understands vg.proto as we know it, and gives up on
+ * anything else.  load() fills in the same records from a generated
+ * vg::Graph and is used as the fallback.
+ */
+class GraphDecoder
+{
+public:
+
+   struct NodeRecord {
+      int64_t _id;
+      const char* _sequence;
+      size_t _length;
+   };
+
+   struct EdgeRecord {
+      int64_t _from;
+      int64_t _to;
+      bool _fromStart;
+      bool _toEnd;
+   };
+
+   /** what (if anything) is wrong with a mapping's edits */
+   enum EditError { NoEditError = 0, EditLengthMismatch, EditSequence };
+
+   struct MappingRecord {
+      int64_t _rank;
+      int64_t _nodeID;
+      int64_t _offset;
+      /** total from_length of the edits, -1 if there are none */
+      int64_t _length;
+      bool _reverse;
+      EditError _editError;
+      /** sequence of the offending edit if _editError is EditSequence */
+      const char* _editSequence;
+      size_t _editSequenceLength;
+   };
+
+   struct PathRecord {
+      const char* _name;
+      size_t _nameLength;
+      /** mappings are _mappings[_firstMapping, _firstMapping +
+       * _numMappings) */
+      size_t _firstMapping;
+      size_t _numMappings;
+   };
+
+   GraphDecoder();
+   ~GraphDecoder();
+
+   void clear();
+
+   /** decode a serialized Graph.  Returns false (leaving the records
+    * in an undefined state) if the bytes aren't a Graph we understand,
+    * in which case the generated parser should be used instead */
+   bool decode(const char* data, size_t size);
+
+   /** fill in the records from a parsed Graph.  They point into graph,
+    * which must not be changed or freed while they're in use */
+   void load(const vg::Graph& graph);
+
+   const std::vector<NodeRecord>& getNodes() const;
+   const std::vector<EdgeRecord>& getEdges() const;
+   const std::vector<PathRecord>& getPaths() const;
+   const std::vector<MappingRecord>& getMappings() const;
+
+protected:
+
+   /** next tag, field number and wire type.  false at end of buffer */
+   static bool readTag(const unsigned char*& pos, const unsigned char* end,
+                       uint32_t& field, uint32_t& wireType);
+   static bool readVarint(const unsigned char*& pos,
+                          const unsigned char* end, uint64_t& value);
+   /** read a length-delimited field, returning its bounds */
+   static bool readBytes(const unsigned char*& pos, const unsigned char* end,
+                         const unsigned char*& begin,
+                         const unsigned char*& fieldEnd);
+   /** skip a field we don't care about */
+   static bool skipField(const unsigned char*& pos, const unsigned char* end,
+                         uint32_t wireType);
+
+   bool decodeNode(const unsigned char* pos, const unsigned char* end);
+   bool decodeEdge(const unsigned char* pos, const unsigned char* end);
+   bool decodePath(const unsigned char* pos, const unsigned char* end);
+   bool decodeMapping(const unsigned char* pos, const unsigned char* end,
+                      MappingRecord& mapping);
+   bool decodePosition(const unsigned char* pos, const unsigned char* end,
+                       MappingRecord& mapping);
+   bool decodeEdit(const unsigned char* pos, const unsigned char* end,
+                   MappingRecord& mapping);
+
+   std::vector<NodeRecord> _nodes;
+   std::vector<EdgeRecord> _edges;
+   std::vector<PathRecord> _paths;
+   std::vector<MappingRecord> _mappings;
+};
+
+inline const std::vector<GraphDecoder::NodeRecord>&
+GraphDecoder::getNodes() const
+{
+  return _nodes;
+}
+
+inline const std::vector<GraphDecoder::EdgeRecord>&
+GraphDecoder::getEdges() const
+{
+  return _edges;
+}
+
+inline const std::vector<GraphDecoder::PathRecord>&
+GraphDecoder::getPaths() const
+{
+  return _paths;
+}
+
+inline const std::vector<GraphDecoder::MappingRecord>&
+GraphDecoder::getMappings() const
+{
+  return _mappings;
+}
+
+#endif
@@ -41,8 +41,8 @@ sgExportPath=${rootPath}/sgExport
 protobufPath=${rootPath}/protobuf
 
 cflags +=  -I ${sgExportPath}
-cppflags +=  -I ${sgExportPath} -I ${protobufPath}/build/include
-basicLibs = ${sgExportPath}/sgExport.a ${protobufPath}/libprotobuf.a -lz
+cppflags +=  -I ${sgExportPath} -I ${protobufPath}/build/include -std=c++11 -pthread
+basicLibs = ${sgExportPath}/sgExport.a ${protobufPath}/libprotobuf.a -lz -lpthread
 basicLibsDependencies = ${sgExportPath}/sgExport.a ${protobufPath}/libprotobuf.a
 
 
@@ -0,0 +1,306 @@
+/*
+ * Copyright (C) 2015 by Glenn Hickey (hickey@soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.cactus
+ */
+
+#include <stdexcept>
+#include <cstring>
+#include <zlib.h>
+#include "inflatestream.h"
+
+using namespace std;
+
+/** how much compressed input to read at a time */
+static const size_t inputBufferSize = 1 << 20;
+
+InflateStream::InflateStream(istream& in, size_t numBuffers,
+                             size_t bufferSize) :
+  _in(in),
+  _buffers(max(numBuffers, (size_t)2)),
+  _filled(0),
+  _released(0),
+  _done(false),
+  _cancelled(false),
+  _current(NULL),
+  _position(0),
+  _byteCount(0)
+{
+  for (size_t i = 0; i < _buffers.size(); ++i)
+  {
+    _buffers[i]._data.resize(bufferSize);
+    _buffers[i]._size = 0;
+  }
+  _thread = thread(&InflateStream::inflateInput, this);
+}
+
+InflateStream::~InflateStream()
+{
+  {
+    lock_guard<mutex> lock(_mutex);
+    _cancelled = true;
+    _cond.notify_all();
+  }
+  _thread.join();
+}
+
+bool InflateStream::Next(const void** data, int* size)
+{
+  if (_current == NULL || _position == _current->_size)
+  {
+    unique_lock<mutex> lock(_mutex);
+    if (_current != NULL)
+    {
+      _current = NULL;
+      ++_released;
+      _cond.notify_all();
+    }
+    while (_filled == _released && !_done)
+    {
+      _cond.wait(lock);
+    }
+    if (_filled == _released)
+    {
+      if (_error)
+      {
+        rethrow_exception(_error);
+      }
+      return false;
+    }
+    _current = &_buffers[_released % _buffers.size()];
+    _position = 0;
+  }
+  *data = _current->_data.data() + _position;
+  *size = (int)(_current->_size - _position);
+  _position = _current->_size;
+  _byteCount += *size;
+  return true;
+}
+
+void InflateStream::BackUp(int count)
+{
+  _position -= count;
+  _byteCount -= count;
+}
+
+bool InflateStream::Skip(int count)
+{
+  const void* data;
+  int size;
+  while (count > 0 && Next(&data, &size))
+  {
+    if (size > count)
+    {
+      BackUp(size - count);
+      size = count;
+    }
+    count -= size;
+  }
+  return count == 0;
+}
+
+int64_t InflateStream::ByteCount() const
+{
+  return _byteCount;
+}
+
+InflateStream::Buffer* InflateStream::waitForEmptyBuffer()
+{
+  unique_lock<mutex> lock(_mutex);
+  while (!_cancelled && _filled - _released >= _buffers.size())
+  {
+    _cond.wait(lock);
+  }
+  if (_cancelled)
+  {
+    return NULL;
+  }
+  Buffer* buffer = &_buffers[_filled % _buffers.size()];
+  buffer->_size = 0;
+  return buffer;
+}
+
+void InflateStream::pushBuffer()
+{
+  lock_guard<mutex> lock(_mutex);
+  ++_filled;
+  _cond.notify_all();
+}
+
+/** gzip magic number followed by the deflate method byte (as
+ * MappedFile::isCompressed()) */
+static bool hasGzipHeader(const unsigned char* data, size_t size)
+{
+  return size >= 3 && data[0] == 0x1f && data[1] == 0x8b &&
+     data[2] == Z_DEFLATED;
+}
+
+/** zlib header with deflate method and no preset dictionary.  this
+ * check is loose enough that the start of an uncompressed vg stream (a
+ * count varint and a length varint) can pass it, see isZlib() */
+static bool hasZlibHeader(const unsigned char* data, size_t size)
+{
+  return size >= 2 && (data[0] & 0x0f) == Z_DEFLATED &&
+     (data[0] >> 4) <= 7 && (data[1] & 0x20) == 0 &&
+     ((data[0] << 8) | data[1]) % 31 == 0;
+}
+
+/** is the first block of the input zlib compressed: it has the header
+ * and inflates without error (to the end of the stream if the block is
+ * all the input there is).  uncompressed data that happens to look
+ * like a header fails to inflate almost straight away */
+static bool isZlib(const char* data, size_t size, bool wholeInput)
+{
+  if (!hasZlibHeader((const unsigned char*)data, size))
+  {
+    return false;
+  }
+  z_stream zs;
+  zs.zalloc = Z_NULL;
+  zs.zfree = Z_NULL;
+  zs.opaque = Z_NULL;
+  zs.next_in = (Bytef*)data;
+  zs.avail_in = (uInt)size;
+  if (inflateInit(&zs) != Z_OK)
+  {
+    return false;
+  }
+  vector<char> scratch(1 << 16);
+  int ret = Z_OK;
+  while (ret == Z_OK && zs.avail_in > 0)
+  {
+    zs.next_out = (Bytef*)scratch.data();
+    zs.avail_out = (uInt)scratch.size();
+    ret = inflate(&zs, Z_NO_FLUSH);
+  }
+  inflateEnd(&zs);
+  return ret == Z_STREAM_END ||
+     (!wholeInput && (ret == Z_OK || ret == Z_BUF_ERROR));
+}
+
+void InflateStream::copyInput(Buffer* out, vector<char>& input,
+                              size_t inputSize)
+{
+  const char* pos = input.data();
+  while (out != NULL && inputSize > 0)
+  {
+    size_t length = min(inputSize, out->_data.size() - out->_size);
+    memcpy(out->_data.data() + out->_size, pos, length);
+    out->_size += length;
+    pos += length;
+    inputSize -= length;
+    if (out->_size == out->_data.size())
+    {
+      pushBuffer();
+      out = waitForEmptyBuffer();
+    }
+    if (inputSize == 0)
+    {
+      _in.read(input.data(), input.size());
+      if (_in.bad())
+      {
+        throw runtime_error("Error reading input");
+      }
+      pos = input.data();
+      inputSize = _in.gcount();
+    }
+  }
+  if (out != NULL && out->_size > 0)
+  {
+    pushBuffer();
+  }
+}
+
+void InflateStream::inflateInput()
+{
+  z_stream zs;
+  zs.zalloc = Z_NULL;
+  zs.zfree = Z_NULL;
+  zs.opaque = Z_NULL;
+  zs.next_in = Z_NULL;
+  zs.avail_in = 0;
+  // 15 bit window, detecting gzip or zlib header
+  if (inflateInit2(&zs, 15 + 32) != Z_OK)
+  {
+    lock_guard<mutex> lock(_mutex);
+    _error = make_exception_ptr(runtime_error("Error initializing zlib"));
+    _done = true;
+    _cond.notify_all();
+    return;
+  }
+  vector<char> input(inputBufferSize);
+  try
+  {
+    Buffer* out = waitForEmptyBuffer();
+    bool inMember = false;
+    bool firstRead = true;
+    while (out != NULL)
+    {
+      if (zs.avail_in == 0)
+      {
+        _in.read(input.data(), input.size());
+        if (_in.bad())
+        {
+          throw runtime_error("Error reading compressed input");
+        }
+        zs.next_in = (Bytef*)input.data();
+        zs.avail_in = (uInt)_in.gcount();
+        if (zs.avail_in == 0)
+        {
+          break;
+        }
+        if (firstRead &&
+            !hasGzipHeader((const unsigned char*)input.data(), zs.avail_in) &&
+            !isZlib(input.data(), zs.avail_in, zs.avail_in < input.size()))
+        {
+          copyInput(out, input, zs.avail_in);
+          out = NULL;
+          break;
+        }
+        firstRead = false;
+      }
+      if (!inMember)
+      {
+        // start of the input or another gzip member after the last
+        inflateReset(&zs);
+        inMember = true;
+      }
+      size_t capacity = out->_data.size();
+      zs.next_out = (Bytef*)out->_data.data() + out->_size;
+      zs.avail_out = (uInt)(capacity - out->_size);
+      int ret = inflate(&zs, Z_NO_FLUSH);
+      if (ret == Z_STREAM_END)
+      {
+        inMember = false;
+      }
+      else if (ret != Z_OK && ret != Z_BUF_ERROR)
+      {
+        throw runtime_error(string("Error decompressing input: ") +
+                            (zs.msg != NULL ? zs.msg : "unknown error"));
+      }
+      out->_size = capacity - zs.avail_out;
+      if (out->_size == capacity)
+      {
+        pushBuffer();
+        out = waitForEmptyBuffer();
+      }
+    }
+    if (inMember)
+    {
+      throw runtime_error("Compressed input is truncated");
+    }
+    if (out != NULL && out->_size > 0)
+    {
+      pushBuffer();
+    }
+  }
+  catch(...)
+  {
+    lock_guard<mutex> lock(_mutex);
+    _error = current_exception();
+  }
+  inflateEnd(&zs);
+  lock_guard<mutex> lock(_mutex);
+  _done = true;
+  _cond.notify_all();
+}
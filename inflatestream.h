@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2015 by Glenn Hickey (hickey@soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.cactus
+ */
+
+#ifndef _INFLATESTREAM_H
+#define _INFLATESTREAM_H
+
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <cstdint>
+#include "google/protobuf/io/zero_copy_stream.h"
+
+/*
+ * Drop-in replacement for protobuf's GzipInputStream that decompresses
+ * on its own thread.  The thread reads the compressed input and
+ * inflates it (gzip or zlib, including concatenated gzip members) into
+ * a ring of large buffers, which the reading thread is handed one at a
+ * time without copying.  So decompression overlaps with whatever the
+ * reading thread does with the data.  Input that isn't compressed (no
+ * gzip magic number, and not a zlib header followed by data that
+ * inflates) is passed through as is, so uncompressed data can be read
+ * from a pipe the same way.
+ */
+class InflateStream : public google::protobuf::io::ZeroCopyInputStream
+{
+public:
+   InflateStream(std::istream& in, size_t numBuffers = 4,
+                 size_t bufferSize = 1 << 22);
+   ~InflateStream();
+
+   /** ZeroCopyInputStream interface.  Next() throws runtime_error if
+    * the input is corrupt or can't be read */
+   bool Next(const void** data, int* size);
+   void BackUp(int count);
+   bool Skip(int count);
+   int64_t ByteCount() const;
+
+protected:
+
+   struct Buffer {
+      std::vector<char> _data;
+      size_t _size;
+   };
+
+   /** inflate the whole input into the ring.  Runs in its own thread */
+   void inflateInput();
+   /** wait for room and return the next buffer to fill, or NULL if
+    * we've been told to stop */
+   Buffer* waitForEmptyBuffer();
+   /** hand a filled buffer to the reader */
+   void pushBuffer();
+   /** copy uncompressed input straight into the ring, starting with
+    * what's already been read into input */
+   void copyInput(Buffer* out, std::vector<char>& input, size_t inputSize);
+
+   std::istream& _in;
+   std::vector<Buffer> _buffers;
+   std::thread _thread;
+   std::mutex _mutex;
+   std::condition_variable _cond;
+   /** number of buffers filled by the inflate thread and released by
+    * the reader, respectively */
+   size_t _filled;
+   size_t _released;
+   bool _done;
+   bool _cancelled;
+   std::exception_ptr _error;
+
+   // reader side (only touched by the reading thread)
+   /** buffer currently handed out, if any */
+   Buffer* _current;
+   /** how much of _current has been handed out */
+   size_t _position;
+   int64_t _byteCount;
+};
+
+#endif
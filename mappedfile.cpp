@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2015 by Glenn Hickey (hickey@soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.cactus
+ */
+
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "mappedfile.h"
+
+using namespace std;
+
+MappedFile::MappedFile() : _data(0), _size(0)
+{
+}
+
+MappedFile::~MappedFile()
+{
+  close();
+}
+
+void MappedFile::open(const string& path)
+{
+  close();
+  int fd = ::open(path.c_str(), O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0)
+  {
+    if (fd >= 0)
+    {
+      ::close(fd);
+    }
+    throw runtime_error(string("Error opening " + path));
+  }
+  _size = st.st_size;
+  if (_size > 0)
+  {
+    void* data = mmap(NULL, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+    {
+      ::close(fd);
+      _size = 0;
+      throw runtime_error(string("Error mapping " + path));
+    }
+    madvise(data, _size, MADV_SEQUENTIAL);
+    _data = (const char*)data;
+  }
+  // mapping stays valid after the descriptor is closed
+  ::close(fd);
+}
+
+void MappedFile::close()
+{
+  if (_data != NULL)
+  {
+    munmap((void*)_data, _size);
+  }
+  _data = NULL;
+  _size = 0;
+}
+
+bool MappedFile::isCompressed() const
+{
+  // gzip magic number followed by the deflate method byte
+  return _size >= 3 &&
+     (unsigned char)_data[0] == 0x1f &&
+     (unsigned char)_data[1] == 0x8b &&
+     (unsigned char)_data[2] == 0x08;
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2015 by Glenn Hickey (hickey@soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.cactus
+ */
+
+#ifndef _MAPPEDFILE_H
+#define _MAPPEDFILE_H
+
+#include <string>
+#include <cstddef>
+
+/*
+ * Read-only memory map of an entire file.  The mapping lives until
+ * close() or destruction.
+ */
+class MappedFile
+{
+public:
+   MappedFile();
+   ~MappedFile();
+
+   /** map a file, throwing runtime_error on failure */
+   void open(const std::string& path);
+   void close();
+
+   const char* getData() const;
+   size_t getSize() const;
+
+   /** true if the file starts with a gzip header */
+   bool isCompressed() const;
+
+private:
+   MappedFile(const MappedFile&);
+   MappedFile& operator=(const MappedFile&);
+
+   const char* _data;
+   size_t _size;
+};
+
+inline const char* MappedFile::getData() const
+{
+  return _data;
+}
+
+inline size_t MappedFile::getSize() const
+{
+  return _size;
+}
+
+#endif
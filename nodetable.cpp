@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) 2015 by Glenn Hickey (hickey@soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.cactus
+ */
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include "nodetable.h"
+
+using namespace std;
+using namespace vg;
+using namespace google::protobuf;
+
+/** order staged nodes by id, then by order added */
+struct StagedLess
+{
+   StagedLess(const vector<Node*>& staged) : _staged(staged) {}
+   bool operator()(size_t i, size_t j) const {
+     return _staged[i]->id() < _staged[j]->id() ||
+        (_staged[i]->id() == _staged[j]->id() && i < j);
+   }
+   const vector<Node*>& _staged;
+};
+
+NodeTable::NodeTable() : _packed(false), _minID(0), _sparseMask(0)
+{
+}
+
+NodeTable::~NodeTable()
+{
+}
+
+void NodeTable::clear()
+{
+  _staged.clear();
+  _stagedSeqs.clear();
+  _nodes.clear();
+  _seqs.clear();
+  _packedSeqs.clear();
+  _dense.clear();
+  _sparse.clear();
+  _minID = 0;
+  _sparseMask = 0;
+  _arena.Reset();
+}
+
+void NodeTable::setPacked(bool packed)
+{
+  assert(_staged.empty() && _nodes.empty());
+  _packed = packed;
+}
+
+void NodeTable::addNode(int64_t id, const string& sequence)
+{
+  Node* node = Arena::CreateMessage<Node>(&_arena);
+  node->set_id(id);
+  if (_packed)
+  {
+    SeqRef seqRef;
+    seqRef._start = _packedSeqs.append(sequence);
+    seqRef._length = sequence.length();
+    _stagedSeqs.push_back(seqRef);
+  }
+  else
+  {
+    node->set_sequence(sequence);
+  }
+  _staged.push_back(node);
+}
+
+void NodeTable::addNodes(NodeTable& other)
+{
+  for (size_t i = 0; i < other._staged.size(); ++i)
+  {
+    addNode(other._staged[i]->id(), other.getStagedSequence(i));
+  }
+  other.clear();
+}
+
+string NodeTable::getStagedSequence(size_t stagedIndex) const
+{
+  if (!_packed)
+  {
+    return _staged[stagedIndex]->sequence();
+  }
+  const SeqRef& seqRef = _stagedSeqs[stagedIndex];
+  string sequence(seqRef._length, 'N');
+  if (seqRef._length > 0)
+  {
+    _packedSeqs.decode(seqRef._start, seqRef._length, &sequence[0]);
+  }
+  return sequence;
+}
+
+void NodeTable::index(bool checkDuplicates)
+{
+  // merge anything staged with what's already in the table
+  _staged.insert(_staged.begin(), _nodes.begin(), _nodes.end());
+  if (_packed)
+  {
+    _stagedSeqs.insert(_stagedSeqs.begin(), _seqs.begin(), _seqs.end());
+  }
+  vector<size_t> order(_staged.size());
+  for (size_t i = 0; i < order.size(); ++i)
+  {
+    order[i] = i;
+  }
+  sort(order.begin(), order.end(), StagedLess(_staged));
+  size_t numUnique = 0;
+  for (size_t i = 0, kept = 0; i < order.size(); ++i)
+  {
+    if (i == 0 || _staged[order[i]]->id() != _staged[order[i-1]]->id())
+    {
+      ++numUnique;
+      kept = order[i];
+    }
+    else if (checkDuplicates)
+    {
+      if (getStagedSequence(order[i]) != getStagedSequence(kept))
+      {
+        stringstream msg;
+        msg << "Node id " << _staged[order[i]]->id() << " found more than "
+            << "once with different sequences";
+        throw runtime_error(msg.str());
+      }
+    }
+  }
+  // duplicates are just dropped: they're freed with the arena
+  _nodes.resize(numUnique);
+  _seqs.resize(_packed ? numUnique : 0);
+  int64_t prevID = 0;
+  for (size_t i = 0, j = 0; i < order.size(); ++i)
+  {
+    int64_t id = _staged[order[i]]->id();
+    if (i == 0 || id != prevID)
+    {
+      if (_packed)
+      {
+        _seqs[j] = _stagedSeqs[order[i]];
+      }
+      _nodes[j++] = _staged[order[i]];
+    }
+    prevID = id;
+  }
+  vector<Node*>().swap(_staged);
+  vector<SeqRef>().swap(_stagedSeqs);
+  _packedSeqs.shrink();
+  buildLookup();
+}
+
+void NodeTable::renumber(const vector<size_t>& order)
+{
+  assert(_staged.empty() && order.size() == _nodes.size());
+  vector<Node*> nodes(order.size());
+  vector<SeqRef> seqs(_packed ? order.size() : 0);
+  for (size_t i = 0; i < order.size(); ++i)
+  {
+    nodes[i] = _nodes[order[i]];
+    nodes[i]->set_id(i);
+    if (_packed)
+    {
+      seqs[i] = _seqs[order[i]];
+    }
+  }
+  _nodes.swap(nodes);
+  _seqs.swap(seqs);
+  buildLookup();
+}
+
+void NodeTable::buildLookup()
+{
+  _dense.clear();
+  _sparse.clear();
+  _minID = 0;
+  _sparseMask = 0;
+  if (_nodes.empty())
+  {
+    return;
+  }
+  _minID = _nodes.front()->id();
+  uint64_t range = (uint64_t)(_nodes.back()->id() - _minID) + 1;
+  if (range <= 2 * _nodes.size() + 1024)
+  {
+    _dense.assign(range, -1);
+    for (size_t i = 0; i < _nodes.size(); ++i)
+    {
+      _dense[_nodes[i]->id() - _minID] = i;
+    }
+  }
+  else
+  {
+    // keep load factor under 1/2
+    size_t capacity = 1024;
+    while (capacity < 2 * _nodes.size())
+    {
+      capacity *= 2;
+    }
+    _sparse.assign(capacity, -1);
+    _sparseMask = capacity - 1;
+    for (size_t i = 0; i < _nodes.size(); ++i)
+    {
+      size_t j = hash(_nodes[i]->id());
+      while (_sparse[j] != -1)
+      {
+        j = (j + 1) & _sparseMask;
+      }
+      _sparse[j] = i;
+    }
+  }
+}
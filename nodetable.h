@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2015 by Glenn Hickey (hickey@soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.cactus
+ */
+
+#ifndef _NODETABLE_H
+#define _NODETABLE_H
+
+#include <vector>
+#include <string>
+#include <cassert>
+#include "google/protobuf/arena.h"
+#include "vg.pb.h"
+#include "packedsequences.h"
+
+/*
+ * Flat table of VG nodes, in id order.  A node's
+ * position in the table is its compacted id in [0, size()).  Lookups by
+ * VG id are O(1) and allocation-free: a vector offset by the minimum id
+ * when ids are dense enough, otherwise an open-addressing hash table.
+ *
+ * Nodes are staged with addNode() then index() must be called before
+ * any lookups.  The nodes themselves are allocated on an arena owned
+ * by the table, so they are never copied around while indexing and
+ * are all freed at once.
+ *
+ * Optionally (see setPacked()), sequences are moved out of the nodes
+ * into a 2-bit packed store, in which case they must be accessed with
+ * getLength() and getSequence() rather than through the node.
+ */
+class NodeTable
+{
+public:
+   NodeTable();
+   ~NodeTable();
+
+   void clear();
+
+   /** pack sequences as they are added.  must be set while the table
+    * is empty (default: false) */
+   void setPacked(bool packed);
+   bool isPacked() const;
+
+   /** stage a node with the given id and sequence */
+   void addNode(int64_t id, const std::string& sequence);
+
+   /** stage all the nodes staged in another table (after the ones
+    * already staged here), leaving it empty */
+   void addNodes(NodeTable& other);
+
+   /** sort the staged nodes by id, dropping duplicate ids (the first
+    * one added wins), and build the id lookup.  If checkDuplicates is
+    * set, throws runtime_error if a dropped node's sequence differs
+    * from the one that's kept */
+   void index(bool checkDuplicates = false);
+
+   /** give the nodes new ids 0 to size()-1: the node that is at 
+    * position order[i] gets id i, and moves to position i */
+   void renumber(const std::vector<size_t>& order);
+
+   size_t size() const;
+   bool empty() const;
+
+   /** get node by its position in the table */
+   const vg::Node& getNode(size_t index) const;
+
+   /** get position in table of node with given id, -1 if not there */
+   int64_t getIndex(int64_t id) const;
+
+   /** get node with given id, NULL if not there */
+   const vg::Node* find(int64_t id) const;
+
+   /** sequence length of node at given position in table */
+   size_t getLength(size_t index) const;
+
+   /** copy length bases, starting at offset, of the sequence of the
+    * node at given position into buffer */
+   void getSequence(size_t index, size_t offset, size_t length,
+                    char* buffer) const;
+
+protected:
+
+   /** where a node's sequence is in the packed store */
+   struct SeqRef {
+      uint64_t _start;
+      uint64_t _length;
+   };
+
+   size_t hash(int64_t id) const;
+
+   /** build the id lookup for the (sorted by id) table */
+   void buildLookup();
+
+   /** sequence of a staged node */
+   std::string getStagedSequence(size_t stagedIndex) const;
+
+   google::protobuf::Arena _arena;
+   std::vector<vg::Node*> _staged;
+   std::vector<SeqRef> _stagedSeqs;
+   std::vector<vg::Node*> _nodes;
+   /** parallel to _nodes when packed */
+   std::vector<SeqRef> _seqs;
+   bool _packed;
+   PackedSequences _packedSeqs;
+   int64_t _minID;
+   /** dense lookup: table index of id is _dense[id - _minID] */
+   std::vector<int64_t> _dense;
+   /** sparse lookup: linear probing table of indexes, -1 is empty */
+   std::vector<int64_t> _sparse;
+   size_t _sparseMask;
+};
+
+inline size_t NodeTable::size() const
+{
+  return _nodes.size();
+}
+
+inline bool NodeTable::empty() const
+{
+  return _nodes.empty();
+}
+
+inline const vg::Node& NodeTable::getNode(size_t index) const
+{
+  return *_nodes[index];
+}
+
+inline bool NodeTable::isPacked() const
+{
+  return _packed;
+}
+
+inline size_t NodeTable::getLength(size_t index) const
+{
+  return _packed ? _seqs[index]._length : _nodes[index]->sequence().length();
+}
+
+inline void NodeTable::getSequence(size_t index, size_t offset,
+                                   size_t length, char* buffer) const
+{
+  assert(offset + length <= getLength(index));
+  if (_packed)
+  {
+    _packedSeqs.decode(_seqs[index]._start + offset, length, buffer);
+  }
+  else
+  {
+    _nodes[index]->sequence().copy(buffer, length, offset);
+  }
+}
+
+inline size_t NodeTable::hash(int64_t id) const
+{
+  // fibonacci hashing to spread out runs of nearby ids
+  return (size_t)(((uint64_t)id * 0x9E3779B97F4A7C15ULL) >> 32) & _sparseMask;
+}
+
+inline int64_t NodeTable::getIndex(int64_t id) const
+{
+  if (!_dense.empty())
+  {
+    uint64_t offset = (uint64_t)(id - _minID);
+    return offset < _dense.size() ? _dense[offset] : -1;
+  }
+  if (!_sparse.empty())
+  {
+    for (size_t i = hash(id); _sparse[i] != -1; i = (i + 1) & _sparseMask)
+    {
+      if (_nodes[_sparse[i]]->id() == id)
+      {
+        return _sparse[i];
+      }
+    }
+  }
+  return -1;
+}
+
+inline const vg::Node* NodeTable::find(int64_t id) const
+{
+  int64_t index = getIndex(id);
+  return index >= 0 ? _nodes[index] : NULL;
+}
+
+#endif
@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2015 by Glenn Hickey (hickey@soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.cactus
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "outputpipe.h"
+
+using namespace std;
+
+OutputPipe::OutputPipe() : _opened(false), _dest(NULL), _error(false)
+{
+}
+
+OutputPipe::~OutputPipe()
+{
+  finish();
+}
+
+void OutputPipe::open(const string& destPath)
+{
+  finish();
+  _destPath = destPath;
+  if (destPath == "-")
+  {
+    _dest = &cout;
+  }
+  else
+  {
+    _destFile.open(destPath.c_str());
+    if (!_destFile)
+    {
+      throw runtime_error("Error opening " + destPath);
+    }
+    _dest = &_destFile;
+  }
+
+  const char* tempDir = getenv("TMPDIR");
+  string dirPath = string(tempDir != NULL && *tempDir != '\0' ?
+                          tempDir : "/tmp") + "/vg2sg.XXXXXX";
+  if (mkdtemp(&dirPath[0]) == NULL)
+  {
+    finish();
+    throw runtime_error("Error creating temporary directory " + dirPath);
+  }
+  _dirPath = dirPath;
+  _pipePath = _dirPath + "/pipe";
+
+  if (mkfifo(_pipePath.c_str(), 0600) != 0)
+  {
+    string pipePath = _pipePath;
+    finish();
+    throw runtime_error("Error creating pipe " + pipePath);
+  }
+
+  _buffer.resize(1 << 20);
+  _error = false;
+  _opened = false;
+  _thread = thread(&OutputPipe::copy, this);
+}
+
+void OutputPipe::close()
+{
+  string destPath = _destPath;
+  if (!finish())
+  {
+    throw runtime_error("Error writing " + destPath);
+  }
+}
+
+void OutputPipe::copy()
+{
+  // blocks until the writer opens the other end.  the pipe isn't
+  // needed on disk after that, so don't leave it lying around if we
+  // get killed (ie by SIGPIPE when stdout goes to head)
+  int fd;
+  do
+  {
+    fd = ::open(_pipePath.c_str(), O_RDONLY);
+  } while (fd < 0 && errno == EINTR);
+  _opened = true;
+  remove(_pipePath.c_str());
+  rmdir(_dirPath.c_str());
+  if (fd < 0)
+  {
+    _error = true;
+    return;
+  }
+#ifdef F_SETPIPE_SZ
+  // a bigger pipe, where we can get one, means the writer and this
+  // thread wait on each other less.  the default is fine too
+  fcntl(fd, F_SETPIPE_SZ, 1 << 20);
+#endif
+
+  // gather reads (no more than a pipe's worth each) into big writes.
+  // after an error keep draining, so the writer never blocks on a
+  // full pipe
+  size_t used = 0;
+  bool done = false;
+  while (!done)
+  {
+    ssize_t bytes = read(fd, &_buffer[used], _buffer.size() - used);
+    if (bytes < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if (bytes < 0)
+    {
+      _error = true;
+    }
+    else
+    {
+      used += bytes;
+    }
+    done = bytes <= 0;
+    if (used > 0 && (done || used == _buffer.size()))
+    {
+      if (!_error)
+      {
+        _dest->write(&_buffer[0], used);
+        _error = !_dest->good();
+      }
+      used = 0;
+    }
+  }
+  ::close(fd);
+}
+
+bool OutputPipe::finish()
+{
+  if (_thread.joinable())
+  {
+    // if the writer never opened the pipe, the copy thread is still
+    // waiting for it to.  opening it ourselves gives it an empty pipe
+    // (and returns straight away in any other case)
+    if (!_opened)
+    {
+      int fd;
+      do
+      {
+        fd = ::open(_pipePath.c_str(), O_WRONLY);
+      } while (fd < 0 && errno == EINTR);
+      if (fd >= 0)
+      {
+        ::close(fd);
+      }
+    }
+    _thread.join();
+  }
+  if (!_pipePath.empty())
+  {
+    remove(_pipePath.c_str());
+    _pipePath.clear();
+  }
+  if (!_dirPath.empty())
+  {
+    rmdir(_dirPath.c_str());
+    _dirPath.clear();
+  }
+
+  bool ok = !_error;
+  if (_dest != NULL)
+  {
+    _dest->flush();
+    ok = ok && _dest->good();
+    if (_destFile.is_open())
+    {
+      _destFile.close();
+      ok = ok && !_destFile.fail();
+    }
+    _dest = NULL;
+  }
+  _destFile.clear();
+  _buffer.clear();
+  _destPath.clear();
+  _error = false;
+  return ok;
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2015 by Glenn Hickey (hickey@soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.cactus
+ */
+
+#ifndef _OUTPUTPIPE_H
+#define _OUTPUTPIPE_H
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <thread>
+#include <atomic>
+
+/*
+ * Stand-in path for an output that gets opened by name by code we
+ * don't control (ie SGSQL::writeDb), so that we still decide how it's
+ * buffered and where it goes.  The path is a named pipe in a fresh
+ * temporary directory (removed as soon as the writer has it open), and
+ * a thread copies whatever is written to it into the real destination
+ * in large blocks.  The destination is either a file or, for "-",
+ * std::cout's streambuf, which is written to where it is rather than
+ * reopened (so stdout isn't truncated and has only the one buffer).
+ */
+class OutputPipe
+{
+public:
+   OutputPipe();
+   ~OutputPipe();
+
+   /** start copying to destPath ("-" for stdout).  Throws
+    * runtime_error if the pipe or the destination can't be opened */
+   void open(const std::string& destPath);
+
+   /** path for the writer to open in place of the destination */
+   const std::string& getPath() const;
+
+   /** wait for everything written to the pipe to be copied, flush the
+    * destination and remove the pipe.  The writer must have closed the
+    * pipe by now (or never opened it).  Throws runtime_error if the
+    * destination couldn't be written */
+   void close();
+
+protected:
+
+   /** copy thread: wait for the writer to open the pipe, then read it
+    * until it's closed */
+   void copy();
+   /** stop the copy thread and clean up, returning false if the
+    * destination couldn't be written */
+   bool finish();
+
+   std::string _destPath;
+   std::string _dirPath;
+   std::string _pipePath;
+   /** set by the copy thread once it's done waiting for the writer */
+   std::atomic<bool> _opened;
+   std::ofstream _destFile;
+   std::ostream* _dest;
+   std::vector<char> _buffer;
+   std::thread _thread;
+   bool _error;
+
+private:
+   OutputPipe(const OutputPipe&);
+   OutputPipe& operator=(const OutputPipe&);
+};
+
+inline const std::string& OutputPipe::getPath() const
+{
+  return _pipePath;
+}
+
+#endif
@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2015 by Glenn Hickey (hickey@soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.cactus
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <cctype>
+#include "packedsequences.h"
+
+using namespace std;
+
+/** lookup tables for packing and unpacking */
+struct PackingTables
+{
+   PackingTables() {
+     const char bases[4] = {'A', 'C', 'G', 'T'};
+     memset(_codes, -1, sizeof(_codes));
+     for (int i = 0; i < 4; ++i)
+     {
+       _codes[(unsigned char)bases[i]] = i;
+       _codes[(unsigned char)tolower(bases[i])] = i;
+     }
+     for (int i = 0; i < 256; ++i)
+     {
+       for (int j = 0; j < 4; ++j)
+       {
+         _bytes[i][j] = bases[(i >> (2 * j)) & 3];
+       }
+     }
+   }
+   /** 2-bit code for ACGTacgt, -1 for everything else */
+   signed char _codes[256];
+   /** the 4 (upper case) bases packed in a byte */
+   char _bytes[256][4];
+};
+
+static const PackingTables tables;
+
+PackedSequences::PackedSequences() : _size(0)
+{
+}
+
+PackedSequences::~PackedSequences()
+{
+}
+
+void PackedSequences::clear()
+{
+  _bits.clear();
+  _size = 0;
+  _exceptions.clear();
+  _lowerCase.clear();
+}
+
+uint64_t PackedSequences::append(const string& sequence)
+{
+  uint64_t start = _size;
+  _bits.resize((_size + sequence.length() + 3) / 4, 0);
+  for (size_t i = 0; i < sequence.length(); ++i, ++_size)
+  {
+    char base = sequence[i];
+    int code = tables._codes[(unsigned char)base];
+    if (code < 0)
+    {
+      // stored as A in the bits, and patched over when decoding
+      addToRuns(_exceptions, _size, base);
+      code = 0;
+    }
+    else if (base >= 'a')
+    {
+      addToRuns(_lowerCase, _size, 0);
+    }
+    _bits[_size / 4] |= code << (2 * (_size % 4));
+  }
+  return start;
+}
+
+void PackedSequences::shrink()
+{
+  _bits.shrink_to_fit();
+  _exceptions.shrink_to_fit();
+  _lowerCase.shrink_to_fit();
+}
+
+void PackedSequences::addToRuns(vector<Run>& runs, uint64_t pos, char base)
+{
+  if (!runs.empty() && runs.back()._base == base &&
+      runs.back()._start + runs.back()._length == pos)
+  {
+    ++runs.back()._length;
+  }
+  else
+  {
+    Run run;
+    run._start = pos;
+    run._length = 1;
+    run._base = base;
+    runs.push_back(run);
+  }
+}
+
+vector<PackedSequences::Run>::const_iterator PackedSequences::findRun(
+  const vector<Run>& runs, uint64_t pos)
+{
+  return upper_bound(runs.begin(), runs.end(), pos, RunEndLess());
+}
+
+void PackedSequences::decode(uint64_t start, uint64_t length,
+                             char* buffer) const
+{
+  uint64_t end = start + length;
+  char* out = buffer;
+  uint64_t pos = start;
+  // up to the first byte boundary one base at a time
+  for (; pos < end && pos % 4 != 0; ++pos)
+  {
+    *out++ = tables._bytes[_bits[pos / 4]][pos % 4];
+  }
+  // then whole bytes
+  for (; pos + 4 <= end; pos += 4, out += 4)
+  {
+    memcpy(out, tables._bytes[_bits[pos / 4]], 4);
+  }
+  for (; pos < end; ++pos)
+  {
+    *out++ = tables._bytes[_bits[pos / 4]][pos % 4];
+  }
+
+  // patch in the soft masking and the non-ACGT bases
+  for (vector<Run>::const_iterator i = findRun(_lowerCase, start);
+       i != _lowerCase.end() && i->_start < end; ++i)
+  {
+    uint64_t first = max(i->_start, start);
+    uint64_t last = min(i->_start + i->_length, end);
+    for (uint64_t j = first; j < last; ++j)
+    {
+      buffer[j - start] = tolower(buffer[j - start]);
+    }
+  }
+  for (vector<Run>::const_iterator i = findRun(_exceptions, start);
+       i != _exceptions.end() && i->_start < end; ++i)
+  {
+    uint64_t first = max(i->_start, start);
+    uint64_t last = min(i->_start + i->_length, end);
+    memset(buffer + first - start, i->_base, last - first);
+  }
+}
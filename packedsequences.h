@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2015 by Glenn Hickey (hickey@soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.cactus
+ */
+
+#ifndef _PACKEDSEQUENCES_H
+#define _PACKEDSEQUENCES_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/*
+ * Append-only store of DNA sequences packed at 2 bits per base.
+ * Anything other than ACGT (N, IUPAC codes, ...) is kept exactly in a
+ * list of exception runs, and soft-masked (lower case) stretches in a
+ * list of case runs, so decoding gives back the original bytes.
+ * Sequences are addressed by their starting position in the store.
+ */
+class PackedSequences
+{
+public:
+   PackedSequences();
+   ~PackedSequences();
+
+   void clear();
+
+   /** total number of bases stored */
+   uint64_t size() const;
+
+   /** add a sequence, returning its start position */
+   uint64_t append(const std::string& sequence);
+
+   /** decode length bases starting at position start into buffer
+    * (which must have room for them) */
+   void decode(uint64_t start, uint64_t length, char* buffer) const;
+
+   /** free any extra capacity once everything's been added */
+   void shrink();
+
+protected:
+
+   /** a stretch of bases [_start, _start + _length) */
+   struct Run {
+      uint64_t _start;
+      uint64_t _length;
+      char _base; // exception runs only
+   };
+   struct RunEndLess {
+      bool operator()(uint64_t pos, const Run& run) const;
+   };
+
+   /** add a base to a run list, extending the last run if possible */
+   static void addToRuns(std::vector<Run>& runs, uint64_t pos, char base);
+
+   /** find the first run that ends after pos */
+   static std::vector<Run>::const_iterator findRun(
+     const std::vector<Run>& runs, uint64_t pos);
+
+   /** 4 bases per byte, first base in the low bits */
+   std::vector<unsigned char> _bits;
+   uint64_t _size;
+   std::vector<Run> _exceptions;
+   std::vector<Run> _lowerCase;
+};
+
+inline uint64_t PackedSequences::size() const
+{
+  return _size;
+}
+
+inline bool PackedSequences::RunEndLess::operator()(uint64_t pos,
+                                                    const Run& run) const
+{
+  return pos < run._start + run._length;
+}
+
+#endif
@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2015 by Glenn Hickey (hickey@soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.cactus
+ */
+
+#include <stdexcept>
+#include "pathfilter.h"
+
+using namespace std;
+
+PathFilter::PathFilter()
+{
+}
+
+PathFilter::~PathFilter()
+{
+}
+
+void PathFilter::addName(const string& name)
+{
+  _names.insert(name);
+}
+
+void PathFilter::addRegex(const string& pattern)
+{
+  try
+  {
+    _regexes.push_back(regex(pattern, regex::ECMAScript | regex::optimize));
+  }
+  catch(regex_error& e)
+  {
+    throw runtime_error("Invalid path regular expression " + pattern + ": " +
+                        e.what());
+  }
+}
+
+bool PathFilter::matches(const string& name) const
+{
+  if (_names.find(name) != _names.end())
+  {
+    return true;
+  }
+  for (size_t i = 0; i < _regexes.size(); ++i)
+  {
+    if (regex_match(name, _regexes[i]))
+    {
+      return true;
+    }
+  }
+  return false;
+}
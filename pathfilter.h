@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2015 by Glenn Hickey (hickey@soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.cactus
+ */
+
+#ifndef _PATHFILTER_H
+#define _PATHFILTER_H
+
+#include <string>
+#include <set>
+#include <vector>
+#include <regex>
+
+/*
+ * Set of path names to load, given as exact names and/or regular
+ * expressions (which must match the whole name).  An empty filter
+ * matches nothing.
+ */
+class PathFilter
+{
+public:
+   PathFilter();
+   ~PathFilter();
+
+   void addName(const std::string& name);
+
+   /** add an ECMAScript regular expression.  throws runtime_error if it
+    * doesn't parse */
+   void addRegex(const std::string& pattern);
+
+   bool matches(const std::string& name) const;
+
+protected:
+
+   std::set<std::string> _names;
+   std::vector<std::regex> _regexes;
+};
+
+#endif
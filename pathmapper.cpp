@@ -9,13 +9,35 @@
 #include <cassert>
 #include <algorithm>
 #include <stack>
+#include <thread>
+#include <atomic>
+#include <exception>
 #include "pathmapper.h"
 #include "pathspanner.h"
 
 using namespace std;
 using namespace vg;
 
-PathMapper::PathMapper() : _sg(0), _lookup(0), _vg(0)
+/** decimal string of an id, without the overhead of a stringstream */
+static void formatID(int64_t id, string& out)
+{
+  char buffer[24];
+  char* end = buffer + sizeof(buffer);
+  char* pos = end;
+  uint64_t value = id < 0 ? -(uint64_t)id : (uint64_t)id;
+  do
+  {
+    *--pos = '0' + value % 10;
+    value /= 10;
+  } while (value != 0);
+  if (id < 0)
+  {
+    *--pos = '-';
+  }
+  out.assign(pos, end - pos);
+}
+
+PathMapper::PathMapper() : _sg(0), _lookup(0), _vg(0), _numThreads(1)
 {
 }
 
@@ -33,67 +55,112 @@ void PathMapper::init(const VGLight* vg)
   delete _sg;
   _sg = new SideGraph();
 
-  _seqStrings.clear();
+  _seqData.clear();
+  _seqRefs.clear();
   _sgPaths.clear();
   _sgSeqToVGPathID.clear();
   _spanningPaths.clear();
+  _pendingPaths.clear();
   
   delete _lookup;
   _lookup = new SGLookup();
-  _nodeIDMap.clear();
   // lookup structure uses string names (relic from hal2sg sequences)
   // here we are mapping node coordinates, so just use nodeId
-  // (note these strings aren't really used for much)
+  // (note these strings aren't really used for much).  the lookup's
+  // sequence ids are node table positions, which are already in 
+  // [0, numNodes), so we never need to map node ids
   vector<string> nodeNames;
-  const VGLight::NodeSet& nodeSet = _vg->getNodeSet();
-  for (VGLight::NodeSet::const_iterator i = nodeSet.begin();
-       i != nodeSet.end(); ++i)
+  const NodeTable& nodeTable = _vg->getNodeTable();
+  nodeNames.resize(nodeTable.size());
+  for (size_t i = 0; i < nodeTable.size(); ++i)
   {
-    stringstream ss;
-    ss << (*i)->id();
-    nodeNames.push_back(ss.str());
-    // make sure we can index our nodes with some number <= numNodes
-    _nodeIDMap.insert(pair<int64_t, sg_int_t>((*i)->id(), _nodeIDMap.size()));
+    formatID(_vg->getOriginalID(nodeTable.getNode(i).id()), nodeNames[i]);
   }
   _lookup->init(nodeNames);
+  NodeMapping unmapped = {-1, 0, false, false};
+  _nodeMappings.assign(nodeTable.size(), unmapped);
 
   // keep all vg paths indexed by name and id
   _pathNames.clear();
   _pathIDs.clear();
 }
 
+void PathMapper::setNumThreads(size_t numThreads)
+{
+  _numThreads = max(numThreads, (size_t)1);
+}
+
 string PathMapper::getSideGraphDNA(sg_int_t seqID, sg_int_t offset,
                                    sg_int_t length, bool reversed) const
 {
-  assert(seqID >= 0 && seqID < _seqStrings.size());
+  string dna;
+  getSideGraphDNA(seqID, offset, length, reversed, dna);
+  return dna;
+}
+
+void PathMapper::getSideGraphDNA(sg_int_t seqID, sg_int_t offset,
+                                 sg_int_t length, bool reversed,
+                                 string& outDNA) const
+{
+  sg_int_t seqLength = getSideGraphDNALength(seqID);
+  assert(offset >= 0 && offset <= seqLength);
   if (length == -1)
   {
-    length = _seqStrings[seqID].length();
+    length = seqLength;
   }
-  string dna = _seqStrings[seqID].substr(offset, length);
-  if (reversed)
+  length = min(length, seqLength - offset);
+  const char* dna = getSideGraphDNAData(seqID) + offset;
+  if (!reversed)
   {
-    VGLight::reverseComplement(dna);
+    outDNA.assign(dna, length);
+  }
+  else
+  {
+    outDNA.resize(length);
+    if (length > 0)
+    {
+      VGLight::reverseComplement(dna, length, &outDNA[0]);
+    }
   }
-  return dna;
 }
 
 string PathMapper::getSideGraphPathDNA(const string& pathName) const
 {
   string outString;
+  getSideGraphPathDNA(pathName, outString);
+  return outString;
+}
+
+void PathMapper::getSideGraphPathDNA(const string& pathName,
+                                     string& outDNA) const
+{
   const vector<SGSegment>& path = getSideGraphPath(pathName);
   size_t pathLen = 0;
-  (void)pathLen;
   for (size_t i = 0; i < path.size(); ++i)
   {
-    outString += getSideGraphDNA(path[i].getSide().getBase().getSeqID(),
-                                 path[i].getMinPos().getPos(),
-                                 path[i].getLength(),
-                                 !path[i].getSide().getForward());
     pathLen += path[i].getLength();
   }
-  assert(pathLen == outString.length());
-  return outString;
+  outDNA.resize(pathLen);
+  // copy each segment straight out of the sequence data
+  size_t pos = 0;
+  for (size_t i = 0; i < path.size(); ++i)
+  {
+    sg_int_t seqID = path[i].getSide().getBase().getSeqID();
+    sg_int_t offset = path[i].getMinPos().getPos();
+    sg_int_t length = path[i].getLength();
+    assert(offset >= 0 && offset + length <= getSideGraphDNALength(seqID));
+    const char* dna = getSideGraphDNAData(seqID) + offset;
+    if (path[i].getSide().getForward())
+    {
+      copy(dna, dna + length, &outDNA[pos]);
+    }
+    else if (length > 0)
+    {
+      VGLight::reverseComplement(dna, length, &outDNA[pos]);
+    }
+    pos += length;
+  }
+  assert(pos == outDNA.length());
 }
 
 const vector<SGSegment>& PathMapper::getSideGraphPath(const string& pathName)
@@ -108,44 +175,55 @@ const string& PathMapper::getVGPathName(const SGSequence* seq) const
 }
 
 void PathMapper::addPath(const std::string& pathName,
-                         const VGLight::MappingList& mappings)
+                         const VGLight::StepList& steps)
 {  
   assert(_pathIDs.find(pathName) == _pathIDs.end());
+  const NodeTable& nodeTable = _vg->getNodeTable();
+
+  // check the whole path first, so nothing is added if it's bad
+  for (size_t i = 0; i < steps.size(); ++i)
+  {
+    assert(steps[i]._offset >= 0);
+    checkStep(pathName, i, steps.size(), steps[i],
+              nodeTable.getLength(steps[i]._node));
+  }
 
   _pathNames.push_back(pathName);
   _pathIDs.insert(pair<string, sg_int_t>(pathName, _pathIDs.size()));
+  _sgPaths.push_back(vector<SGSegment>());
+  vector<SGSegment>& sgPath = _sgPaths.back();
 
+  // one pass: each step is added to the side graph, then
+  // looked up again to extend the side graph path, whose joins are 
+  // added as soon as they can't change.  with more than one thread,
+  // the looking up is left for resolvePaths()
+  bool resolve = _numThreads <= 1;
+  vector<SGJoin*> joins;
   _curSeq = NULL;
   sg_int_t pathID = getPathID(pathName);
   sg_int_t pathPos = 0;
-  size_t mappingCount = 0;
-  for (VGLight::MappingList::const_iterator i = mappings.begin();
-       i != mappings.end(); ++i, ++mappingCount)
+  for (size_t i = 0; i < steps.size(); ++i)
   {
-    Position pos = i->position();
-    bool reversed = pos.is_reverse();
-    sg_int_t segmentLength = _vg->getSegmentLength(*i);
+    const VGLight::PathStep& step = steps[i];
+    bool reversed = step._reverse;
+    int64_t nodeLen = nodeTable.getLength(step._node);
+    int64_t offset = step._offset;
 
     // we never want to only convert a partial node. this is
     // enforced at the beginning and end of paths here:
     // (assumption: offset always relative to forward position 0)
-    const Node* node = _vg->getNode(pos.node_id());
-    size_t nodeLen = node->sequence().length();
-    int64_t offset = pos.offset();
-    // convert to forward-offset, as that is what vg used when logic was written
-    if (reversed) {
-      offset = nodeLen - 1 - offset;
-    }
+    sg_int_t segmentLength = step._length;
+    int64_t startOffset = offset;
     if (!reversed)
     {
       // clamp forward starting point to 0
-      if (i == mappings.begin() && offset > 0)
+      if (i == 0 && offset > 0)
       {
         segmentLength += offset;
-        pos.set_offset(0);
+        startOffset = 0;
       }
       // clamp forward end point to len-1
-      if (i == --mappings.end() && offset + segmentLength < nodeLen)
+      if (i == steps.size() - 1 && offset + segmentLength < nodeLen)
       {
         segmentLength += nodeLen - (offset + segmentLength);
       }
@@ -153,27 +231,192 @@ void PathMapper::addPath(const std::string& pathName,
     else
     {
       // clamp reverse starting point to len-1
-      if (i == mappings.begin() && offset < nodeLen - 1)
+      if (i == 0 && offset < nodeLen - 1)
       {
         segmentLength += nodeLen - 1 - offset;
-        pos.set_offset(0);
+        startOffset = nodeLen - 1;
       }
       // clamp reverse ending point to 0
-      if (i == --mappings.end() && offset - segmentLength > 0)
+      if (i == steps.size() - 1 && offset - segmentLength > 0)
       {
         segmentLength = offset;
       }
     }
 
-    addSegment(pathID, pathPos, pos, reversed, segmentLength);
+    addSegment(pathID, pathPos, step._node, startOffset, reversed,
+               segmentLength);
     pathPos += segmentLength;
+
+    if (resolve)
+    {
+      joins.clear();
+      resolveStep(step, sgPath, _segmentBuffer, joins);
+      for (size_t j = 0; j < joins.size(); ++j)
+      {
+        _sg->addJoin(joins[j]);
+      }
+    }
   }
   if (_curSeq != NULL)
   {
     _sg->addSequence(_curSeq);
   }
   _curSeq = NULL;
-  addPathJoins(pathName, mappings);
+  if (!resolve)
+  {
+    _pendingPaths.push_back(pair<sg_int_t, const VGLight::StepList*>(
+                              pathID, &steps));
+  }
+}
+
+void PathMapper::resolvePaths()
+{
+  // the lookup doesn't change from here on, so paths can be looked up
+  // independently.  each path's joins are kept to be added in the
+  // same order as if it was resolved when it was added
+  vector<vector<SGJoin*> > joins(_pendingPaths.size());
+  vector<exception_ptr> errors(_pendingPaths.size());
+  atomic<size_t> next(0);
+  vector<thread> workers;
+  size_t numWorkers = min(_numThreads, _pendingPaths.size());
+  for (size_t t = 0; t < numWorkers; ++t)
+  {
+    workers.push_back(thread([&]()
+      {
+        vector<SGSegment> buffer;
+        for (size_t i = next++; i < _pendingPaths.size(); i = next++)
+        {
+          try
+          {
+            const VGLight::StepList& steps = *_pendingPaths[i].second;
+            vector<SGSegment>& sgPath = _sgPaths[_pendingPaths[i].first];
+            for (size_t j = 0; j < steps.size(); ++j)
+            {
+              resolveStep(steps[j], sgPath, buffer, joins[i]);
+            }
+          }
+          catch(...)
+          {
+            errors[i] = current_exception();
+          }
+        }
+      }));
+  }
+  for (size_t t = 0; t < workers.size(); ++t)
+  {
+    workers[t].join();
+  }
+  _pendingPaths.clear();
+
+  for (size_t i = 0; i < errors.size(); ++i)
+  {
+    if (errors[i])
+    {
+      for (size_t j = 0; j < joins.size(); ++j)
+      {
+        for (size_t k = 0; k < joins[j].size(); ++k)
+        {
+          delete joins[j][k];
+        }
+      }
+      rethrow_exception(errors[i]);
+    }
+  }
+  for (size_t i = 0; i < joins.size(); ++i)
+  {
+    for (size_t j = 0; j < joins[i].size(); ++j)
+    {
+      _sg->addJoin(joins[i][j]);
+    }
+  }
+}
+
+SGSide PathMapper::mapPosition(size_t nodeIndex, int64_t offset) const
+{
+  const NodeMapping& mapping = _nodeMappings[nodeIndex];
+  if (mapping._seqID != -1)
+  {
+    int64_t length = _vg->getNodeTable().getLength(nodeIndex);
+    if (offset >= 0 && offset < length)
+    {
+      sg_int_t pos = !mapping._reversed ? mapping._seqPos + offset :
+         mapping._seqPos + length - 1 - offset;
+      return SGSide(SGPosition(mapping._seqID, pos), !mapping._reversed);
+    }
+  }
+  else if (mapping._inLookup)
+  {
+    return _lookup->mapPosition(SGPosition(nodeIndex, offset));
+  }
+  return SGSide(SideGraph::NullPos, true);
+}
+
+void PathMapper::addInterval(size_t nodeIndex, int64_t start, int64_t length,
+                             const SGPosition& toPos, bool reversed)
+{
+  NodeMapping& mapping = _nodeMappings[nodeIndex];
+  if (!mapping._inLookup && mapping._seqID == -1 && start == 0 &&
+      length > 0 && length == _vg->getNodeTable().getLength(nodeIndex))
+  {
+    mapping._seqID = toPos.getSeqID();
+    mapping._seqPos = toPos.getPos();
+    mapping._reversed = reversed;
+    return;
+  }
+  if (mapping._seqID != -1)
+  {
+    // node is now in pieces: move its whole-node interval to the lookup
+    _lookup->addInterval(SGPosition(nodeIndex, 0),
+                         SGPosition(mapping._seqID, mapping._seqPos),
+                         _vg->getNodeTable().getLength(nodeIndex),
+                         mapping._reversed);
+    mapping._seqID = -1;
+  }
+  mapping._inLookup = true;
+  _lookup->addInterval(SGPosition(nodeIndex, start), toPos, length, reversed);
+}
+
+void PathMapper::resolveStep(const VGLight::PathStep& step,
+                             vector<SGSegment>& sgPath,
+                             vector<SGSegment>& buffer,
+                             vector<SGJoin*>& joins) const
+{
+  // the path itself only covers the (unclamped) step
+  buffer.clear();
+  const NodeMapping& mapping = _nodeMappings[step._node];
+  // (a reversed step's offset is its last base on the forward strand)
+  int64_t first = !step._reverse ? step._offset :
+     step._offset - step._length + 1;
+  if (mapping._seqID != -1 && first >= 0 && step._length > 0 &&
+      first + step._length <= _vg->getNodeTable().getLength(step._node))
+  {
+    // whole node is one interval, so is the step
+    SGSide side = mapPosition(step._node, step._offset);
+    buffer.push_back(SGSegment(SGSide(side.getBase(),
+                                      side.getForward() != step._reverse),
+                               step._length));
+  }
+  else
+  {
+    SGPosition start(step._node, step._offset);
+    _lookup->getPath(start, step._length, !step._reverse, buffer);
+  }
+  size_t numSegments = sgPath.size();
+  mergePaths(sgPath, buffer);
+  // (the last segment can still grow, but its start is fixed)
+  for (size_t j = max(numSegments, (size_t)1); j < sgPath.size(); ++j)
+  {
+    SGJoin* join = new SGJoin(sgPath[j - 1].getOutSide(),
+                              sgPath[j].getInSide());
+    if (!join->isTrivial())
+    {
+      joins.push_back(join);
+    }
+    else
+    {
+      delete join;
+    }
+  }
 }
 
 void PathMapper::addSpanningPaths()
@@ -182,7 +425,7 @@ void PathMapper::addSpanningPaths()
   {
     throw runtime_error("Spanning paths already added");
   }
-  if (_vg->getNodeSet().empty())
+  if (_vg->getNodeTable().empty())
   {
     return;
   }
@@ -192,20 +435,22 @@ void PathMapper::addSpanningPaths()
   while (ps.hasNextPath() == true)
   {
     string pathName = getSpanningPathName();
-    VGLight::MappingList mappings;
-    ps.getNextPath(mappings);    
-    addPath(pathName, mappings);
-    _spanningPaths.insert(pair<sg_int_t, VGLight::MappingList>(
-                            _pathNames.size()-1, mappings));
+    // (steps are stored first, as they may be looked at again by
+    // resolvePaths())
+    VGLight::StepList& steps = _spanningPaths[_pathNames.size()];
+    ps.getNextPath(steps);    
+    addPath(pathName, steps);
   }
 }
 
 void PathMapper::verifyPaths() const
 {
+  assert(_pendingPaths.empty());
+  string sgDNA;
+  string vgDNA;
   for (int i = 0; i < _pathNames.size(); ++i)
   {
-    string sgDNA = getSideGraphPathDNA(_pathNames[i]);
-    string vgDNA;
+    getSideGraphPathDNA(_pathNames[i], sgDNA);
     if (!isSpanningPath(i))
     {
       _vg->getPathDNA(_pathNames[i], vgDNA);
@@ -225,20 +470,13 @@ void PathMapper::verifyPaths() const
 }
 
 void PathMapper::addSegment(sg_int_t pathID, sg_int_t pathPos,
-                            const Position& pos, bool reversed,
+                            size_t nodeIndex, int64_t offset, bool reversed,
                             sg_int_t segLength)
 {
-  const Node* node = _vg->getNode(pos.node_id());
-  // convert vg offset to forward relative, like it used to be
-  int64_t offset = pos.offset();  
-  if (pos.is_reverse()) {
-    offset = node->sequence().length() - 1 - offset;
-  }
+  const NodeTable& nodeTable = _vg->getNodeTable();
   
   // when mapping, our "from" coordinate is node-relative
-  sg_int_t sgNodeID = _nodeIDMap.find(pos.node_id())->second;
-  SGPosition sgPos(sgNodeID, offset);
-  SGSide mapResult = _lookup->mapPosition(sgPos);
+  SGSide mapResult = mapPosition(nodeIndex, offset);
   bool found = mapResult.getBase() != SideGraph::NullPos;
 
   if (!found)
@@ -248,32 +486,41 @@ void PathMapper::addSegment(sg_int_t pathID, sg_int_t pathPos,
     {
       _curSeq = new SGSequence(_sg->getNumSequences(), 0,
                                makeSeqName(pathID, pathPos));
-      assert(_curSeq->getID() == _seqStrings.size());
-      _seqStrings.push_back("");
+      assert(_curSeq->getID() == _seqRefs.size());
+      SeqRef seqRef = {(sg_int_t)_seqData.length(), 0};
+      _seqRefs.push_back(seqRef);
       _sgSeqToVGPathID.push_back(_pathNames.size()-1);
     }
     // CASE 2) : Extend existing SG Sequence
     sg_int_t curSeqLen = _curSeq->getLength();
-    assert(_curSeq->getID() < _seqStrings.size());
+    assert(_curSeq->getID() == _seqRefs.size() - 1);
     int64_t start = !reversed ? offset : offset - segLength + 1; 
-    string dna = node->sequence().substr(start, segLength);
-    if (reversed == true)
+    assert(reversed || offset + segLength <= nodeTable.getLength(nodeIndex));
+    assert(!reversed || offset - segLength + 1 >= 0);
+    // add dna string to the sequence, reverse complementing on the way
+    // in if need be
+    // (straight onto the end of the sequence data, as the current
+    // sequence is always the last one there)
+    size_t seqPos = _seqData.length();
+    _seqData.resize(seqPos + segLength);
+    if (reversed == false)
     {
-      VGLight::reverseComplement(dna);
+      nodeTable.getSequence(nodeIndex, start, segLength, &_seqData[seqPos]);
+    }
+    else if (segLength > 0)
+    {
+      _dnaBuffer.resize(segLength);
+      nodeTable.getSequence(nodeIndex, start, segLength, &_dnaBuffer[0]);
+      VGLight::reverseComplement(_dnaBuffer.data(), segLength,
+                                 &_seqData[seqPos]);
     }
-    assert(reversed || offset + segLength <= dna.length());
-    assert(!reversed || offset - segLength + 1 >= 0);
-    // add dna string to the sequence
-    _seqStrings[_curSeq->getID()].append(dna);
     _curSeq->setLength(_curSeq->getLength() + segLength);
-    assert(_curSeq->getLength() == _seqStrings[_curSeq->getID()].length());
+    _seqRefs.back()._length += segLength;
+    assert(_curSeq->getLength() == _seqRefs.back()._length);
 
-    // update lookup
+    // update mapping
     SGPosition toPos(_curSeq->getID(), curSeqLen);
-    SGPosition fromPos(sgPos.getSeqID(), !reversed ? sgPos.getPos() :
-                       sgPos.getPos() - segLength + 1);
-    
-    _lookup->addInterval(fromPos, toPos, segLength, reversed);
+    addInterval(nodeIndex, start, segLength, toPos, reversed);
   }
   else
   {
@@ -286,83 +533,48 @@ void PathMapper::addSegment(sg_int_t pathID, sg_int_t pathPos,
   }
 }
 
-// doesn't really need a second pass but whatever
-void PathMapper::addPathJoins(const string& name,
-                              const VGLight::MappingList& mappings)
+void PathMapper::checkStep(const string& name, size_t mappingCount,
+                           size_t numSteps, const VGLight::PathStep& step,
+                           int64_t nodeLen) const
 {
-  _sgPaths.push_back(vector<SGSegment>());
-  vector<SGSegment>& sgPath = _sgPaths.back();
-  int mappingCount = 0;
-  for (VGLight::MappingList::const_iterator i = mappings.begin();
-       i != mappings.end(); ++i, ++mappingCount)
-  {
-    const Position& pos = i->position();
-    bool reversed = pos.is_reverse();
-    const Node* node = _vg->getNode(pos.node_id());
-    int64_t segmentLength = _vg->getSegmentLength(*i);
-    int64_t offset = pos.offset();
-    // convert vg offset to forward relative, like it used to be
-    if (reversed) {
-      offset = node->sequence().length() - 1 - offset;
-    }
-    assert(offset >= 0);
-
-    // do some sanity checks on startpoints
-    if (i != mappings.begin() &&
-        ((!reversed && offset > 0) ||
-         (reversed && offset != node->sequence().length() - 1)))
-    {
-      stringstream ss;
-      ss << "Path " << name << " Mapping rank " << (mappingCount + 1) << ": ";
-      if (reversed)
-      {
-        ss << "(Reverse) ";
-      }
-      ss << "Mapping with offset " << offset
-         << " does not start at node " << node->id() << " endpoint.";
-      throw runtime_error(ss.str());
-    }
-    
-    // and endpoints
-    if (i != --mappings.end() &&
-        ((!reversed && offset + segmentLength != node->sequence().length())
-         || (reversed && offset - segmentLength + 1 != 0)))
+  bool reversed = step._reverse;
+  int64_t segmentLength = step._length;
+  int64_t offset = step._offset;
+  
+  // do some sanity checks on startpoints
+  if (mappingCount != 0 &&
+      ((!reversed && offset > 0) ||
+       (reversed && offset != nodeLen - 1)))
+  {
+    stringstream ss;
+    ss << "Path " << name << " Mapping rank " << (mappingCount + 1) << ": ";
+    if (reversed)
     {
-      stringstream ss;
-      ss << "Path " << name << " Mapping rank " << (mappingCount + 1) << ": ";
-      if (reversed)
-      {
-        ss << "(Reverse) ";
-      }
-      ss << "Mapping with offset " << offset << " and length " << segmentLength
-         << " does not end at endpoint of node " << node->id() << " with length "
-         << node->sequence().length();
-      throw runtime_error(ss.str());
-      
+      ss << "(Reverse) ";
     }
-    
-    sg_int_t nodeID = _nodeIDMap.find(node->id())->second;
-    SGPosition start(nodeID, offset);
-    vector<SGSegment> nextPath;
-    _lookup->getPath(start, segmentLength, !reversed, nextPath);
-
-    mergePaths(sgPath, nextPath);
+    ss << "Mapping with offset " << offset
+       << " does not start at node "
+       << _vg->getOriginalID(_vg->getNodeTable().getNode(step._node).id())
+       << " endpoint.";
+    throw runtime_error(ss.str());
   }
-
-  for (size_t i = 1; i < sgPath.size(); ++i)
+    
+  // and endpoints
+  if (mappingCount != numSteps - 1 &&
+      ((!reversed && offset + segmentLength != nodeLen)
+       || (reversed && offset - segmentLength + 1 != 0)))
   {
-    SGSide srcSide = sgPath[i-1].getOutSide();
-    SGSide tgtSide = sgPath[i].getInSide();
-    SGJoin* join = new SGJoin(srcSide, tgtSide);
-          
-    if (!join->isTrivial())
-    {
-      _sg->addJoin(join);
-    }
-    else
+    stringstream ss;
+    ss << "Path " << name << " Mapping rank " << (mappingCount + 1) << ": ";
+    if (reversed)
     {
-      delete join;
+      ss << "(Reverse) ";
     }
+    ss << "Mapping with offset " << offset << " and length " << segmentLength
+       << " does not end at endpoint of node "
+       << _vg->getOriginalID(_vg->getNodeTable().getNode(step._node).id())
+       << " with length " << nodeLen;
+    throw runtime_error(ss.str());
   }
 }
 
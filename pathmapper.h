@@ -34,8 +34,21 @@ public:
                                sg_int_t length = -1, bool reversed = false)
      const;
 
+   /** get a chunk of DNA sequence from the side graph into outDNA
+    * (which is overwritten, so can be reused between calls) */
+   void getSideGraphDNA(sg_int_t seqID, sg_int_t offset, sg_int_t length,
+                        bool reversed, std::string& outDNA) const;
+
+   /** view of the (forward strand) DNA of a side graph sequence, 
+    * without copying: getSideGraphDNALength() characters, not null
+    * terminated.  Only valid until more sequence is added */
+   const char* getSideGraphDNAData(sg_int_t seqID) const;
+   sg_int_t getSideGraphDNALength(sg_int_t seqID) const;
+
    /** get the DNA sequence of a path in the *side graph* */
    std::string getSideGraphPathDNA(const std::string& pathName) const;
+   void getSideGraphPathDNA(const std::string& pathName,
+                            std::string& outDNA) const;
 
    /** get the path in the Side Graph that corresponds to an added VG path
     */
@@ -49,12 +62,25 @@ public:
    /** add a path by name (leave control of order of addition to 
     * calling code) */
    void addPath(const std::string& name,
-                const VGLight::MappingList& mappings);
+                const VGLight::StepList& steps);
 
    /** add a set of paths that span edges not covered by existing paths
     */
    void addSpanningPaths();
 
+   /** With more than one thread, addPath() only makes the side graph
+    * sequences for a path, and the (read-only) lookup of its side graph
+    * path and joins is left until resolvePaths(), which does all paths
+    * added so far in parallel.  The result is the same either way.
+    * Must be set before adding paths (default: 1) */
+   void setNumThreads(size_t numThreads);
+
+   /** Look up the side graph paths and joins of all the paths added
+    * since the last call (see setNumThreads()).  Must be called before
+    * using them, or verifyPaths().  The steps passed to addPath() must
+    * still be around. */
+   void resolvePaths();
+
    /** was path created using addSpanningPath()? if so, we probably 
     * dont want to write it */
    bool isSpanningPath(sg_int_t id) const;
@@ -72,15 +98,35 @@ public:
 
 protected:
 
-   /** add a segment corresponding to an input node */
+   /** add a segment corresponding to an input node. offset is 
+    * relative to the forward strand of the node. */
    void addSegment(sg_int_t pathID, sg_int_t pathPos,
-                   const vg::Position& pos, bool reversed,
+                   size_t nodeIndex, int64_t offset, bool reversed,
                    sg_int_t segLength);
 
-   /** second pass of input path to compute joins and side graph
-    * segments. */
-   void addPathJoins(const std::string& name,
-                     const VGLight::MappingList& mappings);
+   /** throw an exception if a path step doesn't cover a whole node
+    * (apart from the start of the first step and end of the last) */
+   void checkStep(const std::string& name, size_t mappingCount,
+                  size_t numSteps, const VGLight::PathStep& step,
+                  int64_t nodeLen) const;
+
+   /** look up the side graph segments of a path step, which must 
+    * already be in the side graph, and append them to sgPath.  Adds the
+    * (nontrivial) joins between new segments to joins.  Only reads the
+    * lookup, so can run on several paths at once */
+   void resolveStep(const VGLight::PathStep& step,
+                    std::vector<SGSegment>& sgPath,
+                    std::vector<SGSegment>& buffer,
+                    std::vector<SGJoin*>& joins) const;
+
+   /** side graph side of a node position (as SGLookup::mapPosition()),
+    * from the node's mapping if it has one, otherwise the lookup */
+   SGSide mapPosition(size_t nodeIndex, int64_t offset) const;
+
+   /** add an interval of a node to the mapping (as
+    * SGLookup::addInterval()) */
+   void addInterval(size_t nodeIndex, int64_t start, int64_t length,
+                    const SGPosition& toPos, bool reversed);
 
    /** append path onto the end of prevPath, merging the last segment
     * of prevPath with first segment of nextPath if possible */
@@ -96,19 +142,46 @@ protected:
    /** make a unique spanning path name */
    std::string getSpanningPathName() const;
 
+   /** where a node maps to when one interval covers all of it, which
+    * is (nearly) always the case.  Nodes that are only partially mapped
+    * are left to the lookup */
+   struct NodeMapping {
+      /** side graph sequence, -1 if the node isn't mapped directly */
+      sg_int_t _seqID;
+      sg_int_t _seqPos;
+      bool _reversed;
+      /** the node's intervals are in _lookup instead */
+      bool _inLookup;
+   };
+
    SideGraph* _sg;
    SGLookup* _lookup;
+   /** parallel to the node table */
+   std::vector<NodeMapping> _nodeMappings;
    const VGLight* _vg;
    std::vector<std::string> _pathNames;
    std::map<std::string, sg_int_t> _pathIDs;
-   std::vector<std::string> _seqStrings;
+   /** where a side graph sequence's DNA is in _seqData */
+   struct SeqRef {
+      sg_int_t _start;
+      sg_int_t _length;
+   };
+
+   /** DNA of all the side graph sequences, back to back (a sequence is
+    * only ever extended while it's the last one) */
+   std::string _seqData;
+   std::vector<SeqRef> _seqRefs;
+   /** scratch space for reverse complementing node sequence */
+   std::string _dnaBuffer;
+   /** scratch space for looking up a path step's segments */
+   std::vector<SGSegment> _segmentBuffer;
    std::vector<std::vector<SGSegment> > _sgPaths;
-   // make sure node ids are in range [0, numNodes)
-   // note to self- some of the maps should be hash tables
-   std::map<int64_t, sg_int_t> _nodeIDMap;
    SGSequence* _curSeq;
    std::vector<sg_int_t> _sgSeqToVGPathID;
-   std::map<sg_int_t, VGLight::MappingList> _spanningPaths;
+   std::map<sg_int_t, VGLight::StepList> _spanningPaths;
+   size_t _numThreads;
+   /** paths waiting for resolvePaths(): path id and steps */
+   std::vector<std::pair<sg_int_t, const VGLight::StepList*> > _pendingPaths;
 };
 
 inline const SideGraph* PathMapper::getSideGraph() const
@@ -122,6 +195,18 @@ inline const std::string& PathMapper::getPathName(sg_int_t id) const
   return _pathNames[id];
 }
 
+inline const char* PathMapper::getSideGraphDNAData(sg_int_t seqID) const
+{
+  assert(seqID >= 0 && seqID < _seqRefs.size());
+  return _seqData.data() + _seqRefs[seqID]._start;
+}
+
+inline sg_int_t PathMapper::getSideGraphDNALength(sg_int_t seqID) const
+{
+  assert(seqID >= 0 && seqID < _seqRefs.size());
+  return _seqRefs[seqID]._length;
+}
+
 inline size_t PathMapper::getNumPaths() const
 {
   return _pathNames.size();
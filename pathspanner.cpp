@@ -27,51 +27,47 @@ void PathSpanner::init(const VGLight* vg)
 {
   _vg = vg;
   _uncovered.clear();
-  EdgeSet covered;
+  // flat bitmap over edge index
+  vector<bool> covered(_vg->getNumEdges(), false);
+  const NodeTable& nodeTable = _vg->getNodeTable();
   
   // get edges from existing paths and mark them covered
   const VGLight::PathMap& pathMap = _vg->getPathMap();
   for (VGLight::PathMap::const_iterator i = pathMap.begin();
        i != pathMap.end(); ++i)
   {
-    const VGLight::MappingList& mappings = i->second;
-    if (mappings.size() > 0)
+    const VGLight::StepList& steps = i->second;
+    for (size_t j = 1; j < steps.size(); ++j)
     {
-      VGLight::MappingList::const_iterator prev = mappings.begin();
-      VGLight::MappingList::const_iterator cur = prev;;
-      for (++cur; cur != mappings.end(); ++cur)
+      const VGLight::PathStep& prev = steps[j - 1];
+      const VGLight::PathStep& cur = steps[j];
+      int64_t from = nodeTable.getNode(prev._node).id();
+      int64_t to = nodeTable.getNode(cur._node).id();
+      bool from_start = prev._reverse;
+      bool to_end = cur._reverse;
+      int64_t edgeIndex = _vg->getEdgeIndex(from, to, from_start, to_end);
+      
+      if (edgeIndex < 0)
       {
-        int64_t from = prev->position().node_id();
-        int64_t to = cur->position().node_id();
-        bool from_start = prev->position().is_reverse();
-        bool to_end = cur->position().is_reverse();
-        const Edge* edge = _vg->getEdge(from, to, from_start, to_end);
-        
-        if (edge == NULL)
-        {
-          stringstream ss;
-          ss << "Can't find edge (" << from << "," << to <<") from_start="
-             << from_start << ", to_end=" << to_end << " implied by path "
-             << i->first << ".  This means the path is invalid or, likely "
-             << "I've made a wrong assumption abot the reversal flags";
-          throw runtime_error(ss.str());
-        }
-        covered.insert(edge);
-        prev = cur;
+        stringstream ss;
+        ss << "Can't find edge (" << from << "," << to <<") from_start="
+           << from_start << ", to_end=" << to_end << " implied by path "
+           << i->first << ".  This means the path is invalid or, likely "
+           << "I've made a wrong assumption abot the reversal flags";
+        throw runtime_error(ss.str());
       }
+      covered[edgeIndex] = true;
     }
   }
 
   // mark other edges as uncovered
-  const VGLight::NodeSet& nodeSet = _vg->getNodeSet();
-  vector<const Edge*> edges;
-  for (VGLight::NodeSet::const_iterator i = nodeSet.begin();
-       i != nodeSet.end(); ++i)
+  for (size_t i = 0; i < nodeTable.size(); ++i)
   {
-    _vg->getOutEdges(*i, edges);
-    for (vector<const Edge*>::iterator j = edges.begin(); j != edges.end(); ++j)
+    VGLight::EdgeSpan edges = _vg->getOutEdges(i);
+    for (VGLight::EdgeSpan::const_iterator j = edges.begin();
+         j != edges.end(); ++j)
     {
-      if (covered.find(*j) == covered.end())
+      if (!covered[_vg->getEdgeIndex(*j)])
       {
         _uncovered.insert(*j);
       }
@@ -85,20 +81,20 @@ bool PathSpanner::hasNextPath() const
   return _uncovered.size() > 0;
 }
 
-void PathSpanner::getNextPath(VGLight::MappingList& mappings)
+void PathSpanner::getNextPath(VGLight::StepList& steps)
 {
-  mappings.clear();
+  steps.clear();
   assert(hasNextPath() == true);
   const Edge* edge = *_uncovered.begin();
   _uncovered.erase(_uncovered.begin());
   deque<const Edge*> pathEdges;
-  vector<const Edge*> nextEdges;
+  VGLight::EdgeSpan nextEdges;
   pathEdges.push_back(edge);
 
   // extend right
   for (int prevSize = 0; prevSize < nextEdges.size(); ++prevSize)
   {
-    _vg->getOutEdges(_vg->getNode(pathEdges.back()->to()), nextEdges);
+    nextEdges = _vg->getOutEdges(_vg->getNode(pathEdges.back()->to()));
     // want to find an uncovered edge thats not on the to_end.
     for (int j = 0; j < nextEdges.size(); ++j)
     {
@@ -117,7 +113,7 @@ void PathSpanner::getNextPath(VGLight::MappingList& mappings)
   for (int prevSize = nextEdges.size() - 1; prevSize < nextEdges.size();
        ++prevSize)
   {
-    _vg->getInEdges(_vg->getNode(pathEdges.front()->from()), nextEdges);
+    nextEdges = _vg->getInEdges(_vg->getNode(pathEdges.front()->from()));
     // want to find an uncovered edge thats not on the to_end.
     for (int j = 0; j < nextEdges.size(); ++j)
     {
@@ -133,29 +129,24 @@ void PathSpanner::getNextPath(VGLight::MappingList& mappings)
     }
   }
 
-  // convert path edges to mapping list based on from node
+  // convert path edges to step list based on from node
+  const NodeTable& nodeTable = _vg->getNodeTable();
   for (int i = 0; i < pathEdges.size(); ++i)
   {
     edge = pathEdges[i];
-    Mapping mapping;
-    Position* position = mapping.mutable_position();
-    position->set_is_reverse(edge->from_start());
-    position->set_node_id(edge->from());
-    int64_t nodeLen = _vg->getNode(position->node_id())->sequence().length();
-    position->set_offset(!mapping.position().is_reverse() ? 0 : nodeLen - 1);
-    mappings.push_back(mapping);
+    size_t index = nodeTable.getIndex(edge->from());
+    int64_t nodeLen = nodeTable.getLength(index);
+    steps.push_back(_vg->makeStep(index, !edge->from_start() ? 0 : nodeLen - 1,
+                                  edge->from_start()));
   }
   // pop on last to node
   if (pathEdges.size() > 0)
   {
     edge = pathEdges.back();
-    Mapping mapping;
-    Position* position = mapping.mutable_position();
-    position->set_is_reverse(edge->to_end());
-    position->set_node_id(edge->to());
-    int64_t nodeLen = _vg->getNode(position->node_id())->sequence().length();
-    position->set_offset(!mapping.position().is_reverse() ? 0 : nodeLen - 1);
-    mappings.push_back(mapping);
+    size_t index = nodeTable.getIndex(edge->to());
+    int64_t nodeLen = nodeTable.getLength(index);
+    steps.push_back(_vg->makeStep(index, !edge->to_end() ? 0 : nodeLen - 1,
+                                  edge->to_end()));
   }
 }
 
@@ -30,7 +30,7 @@ public:
    bool hasNextPath() const;
 
    /** get a directed path of uncovered vg edges */
-   void getNextPath(VGLight::MappingList& mappings);
+   void getNextPath(VGLight::StepList& steps);
    
 protected:
 
@@ -12,6 +12,7 @@
 #include <sstream>
 #include "unitTests.h"
 #include "pathmapper.h"
+#include "vg2sgconverter.h"
 
 using namespace std;
 using namespace vg;
@@ -131,6 +132,14 @@ void simpleTest(CuTest *testCase)
   vg.getPathDNA("path", vgPath);
   CuAssertTrue(testCase, vgPath == dna);
   CuAssertTrue(testCase, vgPath == pm.getSideGraphPathDNA("path"));
+  CuAssertTrue(testCase, pm.getSideGraphDNALength(0) == dna.length());
+  CuAssertTrue(testCase, string(pm.getSideGraphDNAData(0),
+                                pm.getSideGraphDNALength(0)) == dna);
+  string buffer = "junk";
+  pm.getSideGraphDNA(0, 6, 20, false, buffer);
+  CuAssertTrue(testCase, buffer == dna.substr(6, 20));
+  pm.getSideGraphPathDNA("path", buffer);
+  CuAssertTrue(testCase, buffer == dna);
 
   vector<const Node*> htap;
   vector<bool> spilf(3, false);
@@ -221,6 +230,7 @@ void inversionTest(CuTest *testCase)
 ///////////////////////////////////////////////////////////
 //  Simple Overlap Test
 //    - paths that share some nodes
+//    - same result when paths are looked up in parallel
 ///////////////////////////////////////////////////////////
 void overlapTest(CuTest *testCase)
 {
@@ -346,6 +356,172 @@ void overlapTest(CuTest *testCase)
   {
     CuAssertTrue(testCase, false);
   }    
+
+  // same again, looking up the side graph paths in parallel at the end
+  PathMapper parallel;
+  parallel.init(&vg);
+  parallel.setNumThreads(4);
+  const char* pathNames[4] = {"path1", "path2", "path3", "path4"};
+  for (int i = 0; i < 4; ++i)
+  {
+    parallel.addPath(pathNames[i], vg.getPath(pathNames[i]));
+  }
+  parallel.resolvePaths();
+  const SideGraph* parallelSG = parallel.getSideGraph();
+  CuAssertTrue(testCase, parallelSG->getNumSequences() == 3);
+  for (int i = 0; i < 4; ++i)
+  {
+    CuAssertTrue(testCase, parallel.getSideGraphPath(pathNames[i]) ==
+                 pm.getSideGraphPath(pathNames[i]));
+  }
+  CuAssertTrue(testCase, parallelSG->getJoinSet().size() ==
+               sg->getJoinSet().size());
+  CuAssertTrue(testCase, parallelSG->getJoin(&trueJoin1) != NULL);
+  CuAssertTrue(testCase, parallelSG->getJoin(&trueJoin4) != NULL);
+  CuAssertTrue(testCase, parallelSG->getJoin(&trueJoin5) != NULL);
+  try {
+    parallel.verifyPaths();
+  }
+  catch(...)
+  {
+    CuAssertTrue(testCase, false);
+  }    
+}
+
+///////////////////////////////////////////////////////////
+//  Converter Test
+//    - a graph held as chunks in memory converted through
+//      the library interface, with and without renumbering
+///////////////////////////////////////////////////////////
+void converterTest(CuTest *testCase)
+{
+  string dna = "ACAAACACACAGGGTACACGTACAGACCGACTTAGCAGAGAT";
+  Graph graph;
+  vector<const Node*> path;
+  vector<bool> flips(3, false);
+  path.push_back(makeNode(graph, 10, dna.substr(0, 6)));
+  path.push_back(makeNode(graph, 30, dna.substr(6, 20)));
+  path.push_back(makeNode(graph, 20, dna.substr(26, 16)));
+  makePath(graph, "path", path, flips);
+
+  // nodes and edges in one chunk, the path in the other
+  Graph pathChunk;
+  *pathChunk.add_path() = graph.path(0);
+  graph.clear_path();
+  vector<const Graph*> chunks;
+  chunks.push_back(&graph);
+  chunks.push_back(&pathChunk);
+
+  for (int reorder = 0; reorder < 2; ++reorder)
+  {
+    VGLight vg;
+    vg.loadGraphChunks(chunks);
+    CuAssertTrue(testCase, vg.getNodeTable().size() == 3);
+    CuAssertTrue(testCase, vg.getNumEdges() == 2);
+    VG2SGConverter converter;
+    converter.setReorder(reorder == 1);
+    converter.convert(&vg);
+    CuAssertTrue(testCase, vg.hasCompactIDs() == (reorder == 1));
+    CuAssertTrue(testCase, converter.getPrimaryPath() == "path");
+    CuAssertTrue(testCase, converter.getNumPaths() == 1);
+    CuAssertTrue(testCase, converter.getPathName(0) == "path");
+    CuAssertTrue(testCase, !converter.isSpanningPath(0));
+    const SideGraph* sg = converter.getSideGraph();
+    CuAssertTrue(testCase, sg->getNumSequences() == 1);
+    CuAssertTrue(testCase, converter.getSideGraphDNA(0) == dna);
+    CuAssertTrue(testCase, converter.getSideGraphPath("path").size() == 1);
+    CuAssertTrue(testCase,
+                 converter.getPathMapper()->getSideGraphPathDNA("path") ==
+                 dna);
+  }
+
+  // nothing to convert without paths unless spanning
+  VGLight vg;
+  vg.loadGraph(graph);
+  VG2SGConverter converter;
+  bool caught = false;
+  try
+  {
+    converter.convert(&vg);
+  }
+  catch(runtime_error& e)
+  {
+    caught = true;
+  }
+  CuAssertTrue(testCase, caught);
+  converter.setSpan(true);
+  converter.convert(&vg);
+  CuAssertTrue(testCase, converter.getNumPaths() > 0);
+  for (size_t i = 0; i < converter.getNumPaths(); ++i)
+  {
+    CuAssertTrue(testCase, converter.isSpanningPath(i));
+  }
+  CuAssertTrue(testCase, converter.getPrimaryPath().empty());
+}
+
+///////////////////////////////////////////////////////////
+//  Partial Node Test
+//    - a path that ends partway into a reversed node, which
+//      is mapped through the lookup rather than as a whole node
+//    - a bad path is rejected without adding anything
+///////////////////////////////////////////////////////////
+void partialNodeTest(CuTest *testCase)
+{
+  string dna1 = "ACAAACAC";
+  string dna2 = "GGGTACACGT";
+  Graph graph;
+  makeNode(graph, 1, dna1);
+  makeNode(graph, 2, dna2);
+  makeEdge(graph, 1, 2, false, true);
+  VGLight vg;
+  vg.loadGraph(graph);
+
+  // all of node 1, then bases 9 to 7 of the reverse of node 2
+  VGLight::StepList steps(2);
+  steps[0]._node = vg.getNodeTable().getIndex(1);
+  steps[0]._offset = 0;
+  steps[0]._length = dna1.length();
+  steps[0]._reverse = 0;
+  steps[1]._node = vg.getNodeTable().getIndex(2);
+  steps[1]._offset = 9;
+  steps[1]._length = 3;
+  steps[1]._reverse = 1;
+  string tail = dna2.substr(7, 3);
+  VGLight::reverseComplement(tail);
+  string expected = dna1 + tail;
+
+  for (size_t numThreads = 1; numThreads <= 2; ++numThreads)
+  {
+    PathMapper pm;
+    pm.init(&vg);
+    pm.setNumThreads(numThreads);
+    pm.addPath("path", steps);
+    pm.resolvePaths();
+    CuAssertTrue(testCase, pm.getSideGraphPathDNA("path") == expected);
+    const vector<SGSegment>& sgPath = pm.getSideGraphPath("path");
+    CuAssertTrue(testCase, sgPath.size() == 1);
+    CuAssertTrue(testCase, sgPath[0].getLength() == expected.length());
+  }
+
+  // a path that goes wrong after its first node leaves nothing behind
+  VGLight::StepList badSteps = steps;
+  badSteps[1]._offset = 5;
+  PathMapper pm;
+  pm.init(&vg);
+  bool caught = false;
+  try
+  {
+    pm.addPath("bad", badSteps);
+  }
+  catch(runtime_error& e)
+  {
+    caught = true;
+  }
+  CuAssertTrue(testCase, caught);
+  CuAssertTrue(testCase, pm.getNumPaths() == 0);
+  CuAssertTrue(testCase, pm.getSideGraph()->getNumSequences() == 0);
+  pm.addPath("bad", steps);
+  CuAssertTrue(testCase, pm.getSideGraphPathDNA("bad") == expected);
 }
 
 CuSuite* pathMapperTestSuite(void) 
@@ -354,5 +530,7 @@ CuSuite* pathMapperTestSuite(void)
   SUITE_ADD_TEST(suite, simpleTest);
   SUITE_ADD_TEST(suite, inversionTest);
   SUITE_ADD_TEST(suite, overlapTest);
+  SUITE_ADD_TEST(suite, converterTest);
+  SUITE_ADD_TEST(suite, partialNodeTest);
   return suite;
 }
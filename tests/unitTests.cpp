@@ -10,6 +10,7 @@ int runAllTests(void) {
   CuString *output = CuStringNew();
   CuSuite* suite = CuSuiteNew(); 
   CuSuiteAddSuite(suite, pathMapperTestSuite());
+  CuSuiteAddSuite(suite, vgLightTestSuite());
   CuSuiteRun(suite);
   CuSuiteSummary(suite, output);
   CuSuiteDetails(suite, output);
@@ -12,5 +12,6 @@ extern "C" {
 }
 
 CuSuite* pathMapperTestSuite();
+CuSuite* vgLightTestSuite();
 
 #endif
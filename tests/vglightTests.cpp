@@ -0,0 +1,1152 @@
+/*
+ * Copyright (C) 2015 by Glenn Hickey (hickey@soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <fstream>
+#include <iterator>
+#include <set>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
+#include "google/protobuf/io/gzip_stream.h"
+#include "google/protobuf/io/coded_stream.h"
+#include "unitTests.h"
+#include "vglight.h"
+#include "graphcache.h"
+#include "gfareader.h"
+#include "inflatestream.h"
+#include "chunkpipeline.h"
+#include "outputpipe.h"
+
+using namespace std;
+using namespace vg;
+using namespace google::protobuf::io;
+
+///////////////////////////////////////////////////////////
+//  Node Table Test
+//    - lookups with dense ids and with very sparse ids
+//    - duplicate ids (first one wins)
+///////////////////////////////////////////////////////////
+static void checkNodeTable(CuTest* testCase, int64_t step)
+{
+  Graph graph;
+  for (int64_t i = 100; i > 0; --i)
+  {
+    Node* node = graph.add_node();
+    node->set_id(i * step);
+    node->set_sequence(string(1 + i % 7, 'A'));
+  }
+  Node* dupe = graph.add_node();
+  dupe->set_id(50 * step);
+  dupe->set_sequence("C");
+  
+  VGLight vg;
+  vg.loadGraph(graph);
+  const NodeTable& nodeTable = vg.getNodeTable();
+  CuAssertTrue(testCase, nodeTable.size() == 100);
+  for (int64_t i = 1; i <= 100; ++i)
+  {
+    CuAssertTrue(testCase, nodeTable.getIndex(i * step) == i - 1);
+    CuAssertTrue(testCase, nodeTable.getNode(i - 1).id() == i * step);
+    const Node* node = vg.getNode(i * step);
+    CuAssertTrue(testCase, node != NULL && node->id() == i * step);
+    CuAssertTrue(testCase, node->sequence() == string(1 + i % 7, 'A'));
+  }
+  CuAssertTrue(testCase, vg.getNode(0) == NULL);
+  CuAssertTrue(testCase, step == 1 || vg.getNode(step + 1) == NULL);
+  CuAssertTrue(testCase, vg.getNode(101 * step) == NULL);
+  CuAssertTrue(testCase, vg.getNode(-step) == NULL);
+}
+
+void nodeTableTest(CuTest *testCase)
+{
+  checkNodeTable(testCase, 1);
+  checkNodeTable(testCase, 3);
+  checkNodeTable(testCase, 1000003);
+}
+
+///////////////////////////////////////////////////////////
+//  Adjacency Test
+//    - in and out edges of every node in a small graph,
+//      including a dangling edge to a missing node
+//    - hashed edge lookup
+///////////////////////////////////////////////////////////
+void adjacencyTest(CuTest *testCase)
+{
+  Graph graph;
+  for (int64_t i = 1; i <= 4; ++i)
+  {
+    Node* node = graph.add_node();
+    node->set_id(i * 10);
+    node->set_sequence("ACGT");
+  }
+  int64_t edges[6][2] = {{30, 40}, {10, 20}, {10, 30}, {20, 40},
+                         {10, 20}, {40, 50}};
+  for (int i = 0; i < 6; ++i)
+  {
+    Edge* edge = graph.add_edge();
+    edge->set_from(edges[i][0]);
+    edge->set_to(edges[i][1]);
+    edge->set_from_start(i == 4);
+  }
+  VGLight vg;
+  vg.loadGraph(graph);
+  CuAssertTrue(testCase, vg.getNumEdges() == 6);
+
+  VGLight::EdgeSpan outs = vg.getOutEdges(vg.getNode(10));
+  CuAssertTrue(testCase, outs.size() == 3);
+  // input order is kept within a node
+  CuAssertTrue(testCase, outs[0]->to() == 20 && !outs[0]->from_start());
+  CuAssertTrue(testCase, outs[1]->to() == 30);
+  CuAssertTrue(testCase, outs[2]->to() == 20 && outs[2]->from_start());
+  CuAssertTrue(testCase, vg.getOutEdges((size_t)1).size() == 1);
+  CuAssertTrue(testCase, vg.getOutEdges(vg.getNode(40)).size() == 1);
+  CuAssertTrue(testCase, vg.getOutEdges(vg.getNode(40))[0]->to() == 50);
+
+  CuAssertTrue(testCase, vg.getInEdges(vg.getNode(10)).empty());
+  CuAssertTrue(testCase, vg.getInEdges(vg.getNode(20)).size() == 2);
+  VGLight::EdgeSpan ins = vg.getInEdges(vg.getNode(40));
+  CuAssertTrue(testCase, ins.size() == 2);
+  CuAssertTrue(testCase, ins[0]->from() == 20 && ins[1]->from() == 30);
+
+  CuAssertTrue(testCase, vg.getEdge(10, 20, true, false) == outs[2]);
+  CuAssertTrue(testCase, vg.getEdge(10, 20, false, false) == outs[0]);
+  CuAssertTrue(testCase, vg.getEdge(10, 20, false, true) == NULL);
+  CuAssertTrue(testCase, vg.getEdge(20, 10, false, false) == NULL);
+  CuAssertTrue(testCase, vg.getEdge(50, 40, false, false) == NULL);
+
+  // edge indexes are distinct and in range, and duplicate edges
+  // share the first one's
+  set<int64_t> indexes;
+  for (size_t i = 0; i < vg.getNodeTable().size(); ++i)
+  {
+    VGLight::EdgeSpan edgeSpan = vg.getOutEdges(i);
+    for (size_t j = 0; j < edgeSpan.size(); ++j)
+    {
+      int64_t index = vg.getEdgeIndex(edgeSpan[j]);
+      CuAssertTrue(testCase, index >= 0 && index < vg.getNumEdges());
+      indexes.insert(index);
+    }
+  }
+  CuAssertTrue(testCase, indexes.size() == 6);
+  *graph.add_edge() = graph.edge(0);
+  vg.loadGraph(graph);
+  CuAssertTrue(testCase, vg.getInEdges(vg.getNode(40)).size() == 3);
+  CuAssertTrue(testCase, vg.getEdgeIndex(30, 40, false, false) ==
+               vg.getEdgeIndex(vg.getOutEdges(vg.getNode(30))[1]));
+}
+
+///////////////////////////////////////////////////////////
+//  Path Step Test
+//    - mappings are sorted by rank and converted to forward
+//      offsets and lengths
+//    - paths with nontrivial edits throw when their DNA is 
+//      requested
+///////////////////////////////////////////////////////////
+void pathStepTest(CuTest *testCase)
+{
+  Graph graph;
+  const char* seqs[3] = {"ACGTA", "CCA", "GATTACA"};
+  for (int64_t i = 0; i < 3; ++i)
+  {
+    Node* node = graph.add_node();
+    node->set_id(i + 1);
+    node->set_sequence(seqs[i]);
+  }
+  // path visits 3- (from 2nd last base), 1+ then 2+ (first 2 bases)
+  Path* path = graph.add_path();
+  path->set_name("path");
+  int64_t ids[3] = {2, 3, 1};
+  int64_t ranks[3] = {3, 1, 2};
+  for (int i = 0; i < 3; ++i)
+  {
+    Mapping* mapping = path->add_mapping();
+    mapping->set_rank(ranks[i]);
+    mapping->mutable_position()->set_node_id(ids[i]);
+  }
+  path->mutable_mapping(1)->mutable_position()->set_is_reverse(true);
+  path->mutable_mapping(1)->mutable_position()->set_offset(1);
+  Edit* edit = path->mutable_mapping(0)->add_edit();
+  edit->set_from_length(2);
+  edit->set_to_length(2);
+
+  Path* badPath = graph.add_path();
+  badPath->set_name("bad");
+  Mapping* mapping = badPath->add_mapping();
+  mapping->set_rank(1);
+  mapping->mutable_position()->set_node_id(1);
+  edit = mapping->add_edit();
+  edit->set_from_length(1);
+  edit->set_to_length(1);
+  edit->set_sequence("T");
+
+  VGLight vg;
+  vg.loadGraph(graph);
+  const VGLight::StepList& steps = vg.getPath("path");
+  CuAssertTrue(testCase, steps.size() == 3);
+  CuAssertTrue(testCase, steps[0]._node == 2 && steps[0]._reverse);
+  CuAssertTrue(testCase, steps[0]._offset == 5 && steps[0]._length == 6);
+  CuAssertTrue(testCase, steps[1]._node == 0 && !steps[1]._reverse);
+  CuAssertTrue(testCase, steps[1]._offset == 0 && steps[1]._length == 5);
+  CuAssertTrue(testCase, steps[2]._node == 1 && !steps[2]._reverse);
+  CuAssertTrue(testCase, steps[2]._offset == 0 && steps[2]._length == 2);
+
+  string dna;
+  vg.getPathDNA("path", dna);
+  CuAssertTrue(testCase, dna == "GTAATCACGTACC");
+
+  bool caught = false;
+  try
+  {
+    vg.getPathDNA("bad", dna);
+  }
+  catch(runtime_error& e)
+  {
+    caught = true;
+  }
+  CuAssertTrue(testCase, caught);
+}
+
+///////////////////////////////////////////////////////////
+//  Chunked Path Test
+//    - a path split over several chunks, with runs out of 
+//      order and duplicate ranks, is merged back in rank
+//      order keeping the first copy of each rank
+///////////////////////////////////////////////////////////
+void chunkedPathTest(CuTest *testCase)
+{
+  // chunk, rank and node of each mapping, in stream order
+  int64_t mappings[8][3] = {{0, 3, 3}, {0, 4, 4},
+                            {1, 2, 2}, {1, 1, 1}, {1, 4, 6},
+                            {2, 5, 5}, {2, 3, 6}, {2, 6, 6}};
+  vector<Graph> chunks(3);
+  for (int64_t i = 1; i <= 6; ++i)
+  {
+    Node* node = chunks[i % 3].add_node();
+    node->set_id(i);
+    node->set_sequence(string(i, 'A'));
+  }
+  for (int i = 0; i < 8; ++i)
+  {
+    Graph& chunk = chunks[mappings[i][0]];
+    if (chunk.path_size() == 0)
+    {
+      chunk.add_path()->set_name("path");
+    }
+    Mapping* mapping = chunk.mutable_path(0)->add_mapping();
+    mapping->set_rank(mappings[i][1]);
+    mapping->mutable_position()->set_node_id(mappings[i][2]);
+  }
+
+  // write in the vg stream format: count followed by sized messages
+  string buffer;
+  {
+    StringOutputStream stringStream(&buffer);
+    GzipOutputStream gzipStream(&stringStream);
+    CodedOutputStream codedStream(&gzipStream);
+    codedStream.WriteVarint64(chunks.size());
+    for (size_t i = 0; i < chunks.size(); ++i)
+    {
+      string bytes;
+      chunks[i].SerializeToString(&bytes);
+      codedStream.WriteVarint32(bytes.length());
+      codedStream.WriteString(bytes);
+    }
+  }
+  stringstream stream(buffer);
+  VGLight vg;
+  vg.setNumThreads(2);
+  vg.loadGraph(stream);
+
+  const VGLight::StepList& steps = vg.getPath("path");
+  int64_t expected[6] = {1, 2, 3, 4, 5, 6};
+  CuAssertTrue(testCase, steps.size() == 6);
+  for (size_t i = 0; i < 6; ++i)
+  {
+    const Node& node = vg.getNodeTable().getNode(steps[i]._node);
+    CuAssertTrue(testCase, node.id() == expected[i]);
+  }
+}
+
+///////////////////////////////////////////////////////////
+//  Packed Sequence Test
+//    - sequences with soft masking, Ns and other codes come
+//      back out of the packed store unchanged, from any
+//      offset
+//    - path DNA is the same with packed and unpacked nodes
+///////////////////////////////////////////////////////////
+void packedSequenceTest(CuTest *testCase)
+{
+  const char* seqs[4] = {"ACGTTGCAacgtNNNNNNRYacgTTTn", "G", "",
+                         "nnnnACGTAAAAccccGGGGTTTTmkACGTACGTAcgt"};
+  PackedSequences packed;
+  vector<uint64_t> starts;
+  for (int i = 0; i < 4; ++i)
+  {
+    starts.push_back(packed.append(seqs[i]));
+  }
+  CuAssertTrue(testCase, packed.size() == starts.back() + strlen(seqs[3]));
+  for (int i = 0; i < 4; ++i)
+  {
+    string seq(seqs[i]);
+    for (size_t start = 0; start < seq.length(); ++start)
+    {
+      for (size_t length = 0; start + length <= seq.length(); ++length)
+      {
+        string buffer(length, '\0');
+        packed.decode(starts[i] + start, length, &buffer[0]);
+        CuAssertTrue(testCase, buffer == seq.substr(start, length));
+      }
+    }
+  }
+
+  Graph graph;
+  Path* path = graph.add_path();
+  path->set_name("path");
+  for (int64_t i = 0; i < 4; ++i)
+  {
+    Node* node = graph.add_node();
+    node->set_id(i + 1);
+    node->set_sequence(seqs[i]);
+    Mapping* mapping = path->add_mapping();
+    mapping->set_rank(i + 1);
+    mapping->mutable_position()->set_node_id(i + 1);
+    mapping->mutable_position()->set_is_reverse(i % 2 == 0);
+  }
+  VGLight vg;
+  vg.loadGraph(graph);
+  string dna;
+  vg.getPathDNA("path", dna);
+  VGLight packedVG;
+  packedVG.setPackedSequences(true);
+  packedVG.loadGraph(graph);
+  CuAssertTrue(testCase, packedVG.getNodeTable().isPacked());
+  CuAssertTrue(testCase, packedVG.getNode(1)->sequence().empty());
+  CuAssertTrue(testCase, packedVG.getNodeTable().getLength(0) == 
+               strlen(seqs[0]));
+  string packedDNA;
+  packedVG.getPathDNA("path", packedDNA);
+  CuAssertTrue(testCase, dna.length() == 27 + 1 + 38);
+  CuAssertTrue(testCase, packedDNA == dna);
+}
+
+///////////////////////////////////////////////////////////
+//  Reverse Complement Test
+//    - all the ways of reverse complementing agree with a
+//      simple reference on random sequences of all lengths,
+//      with and without gaps (which stay where they are)
+///////////////////////////////////////////////////////////
+void reverseComplementTest(CuTest *testCase)
+{
+  const char alphabet[] = "ACGTacgtNnRYKM*.X";
+  srand(0);
+  for (size_t length = 0; length < 300; ++length)
+  {
+    for (int gaps = 0; gaps < 2; ++gaps)
+    {
+      string seq(length, 'A');
+      for (size_t i = 0; i < length; ++i)
+      {
+        seq[i] = alphabet[rand() % (sizeof(alphabet) - 1)];
+        if (gaps && rand() % 10 == 0)
+        {
+          seq[i] = '-';
+        }
+      }
+      // reference: reverse complement the non-gap characters in place
+      vector<size_t> bases;
+      for (size_t i = 0; i < length; ++i)
+      {
+        if (seq[i] != '-')
+        {
+          bases.push_back(i);
+        }
+      }
+      string truth(seq);
+      for (size_t i = 0; i < bases.size(); ++i)
+      {
+        truth[bases[i]] = VGLight::reverseComplement(
+          seq[bases[bases.size() - 1 - i]]);
+      }
+
+      string inPlace(seq);
+      VGLight::reverseComplement(inPlace);
+      CuAssertTrue(testCase, inPlace == truth);
+      string outOfPlace(length, '\0');
+      if (length > 0)
+      {
+        VGLight::reverseComplement(seq.data(), length, &outOfPlace[0]);
+      }
+      CuAssertTrue(testCase, outOfPlace == truth);
+    }
+  }
+}
+
+///////////////////////////////////////////////////////////
+//  Graph Cache Test
+//    - a graph read back from a cache matches the graph it
+//      was written from
+//    - the cache is ignored once the input changes or can't
+//      be read
+//    - a graph loaded with a path filter can't be cached
+///////////////////////////////////////////////////////////
+void graphCacheTest(CuTest *testCase)
+{
+  Graph graph;
+  for (int64_t i = 1; i <= 5; ++i)
+  {
+    Node* node = graph.add_node();
+    node->set_id(i * 7);
+    node->set_sequence(string(i, "ACGTN"[i % 5]));
+  }
+  for (int64_t i = 1; i <= 5; ++i)
+  {
+    Edge* edge = graph.add_edge();
+    edge->set_from(i * 7);
+    edge->set_to(((i % 5) + 1) * 7);
+    edge->set_to_end(i == 3);
+  }
+  Path* path = graph.add_path();
+  path->set_name("path");
+  for (int64_t i = 1; i <= 3; ++i)
+  {
+    Mapping* mapping = path->add_mapping();
+    mapping->set_rank(i);
+    mapping->mutable_position()->set_node_id(i * 7);
+  }
+  Edit* edit = path->add_mapping()->add_edit();
+  edit->set_from_length(1);
+  edit->set_to_length(2);
+  path->mutable_mapping(3)->set_rank(4);
+  path->mutable_mapping(3)->mutable_position()->set_node_id(28);
+
+  // uncompressed stream with one chunk
+  string inputPath = "graphCacheTest.vg";
+  string cachePath = GraphCache::getCachePath(inputPath);
+  {
+    string bytes;
+    graph.SerializeToString(&bytes);
+    string buffer;
+    StringOutputStream stringStream(&buffer);
+    {
+      CodedOutputStream codedStream(&stringStream);
+      codedStream.WriteVarint64(1);
+      codedStream.WriteVarint32(bytes.length());
+      codedStream.WriteString(bytes);
+    }
+    ofstream inputStream(inputPath.c_str(), ios::binary);
+    inputStream.write(buffer.data(), buffer.length());
+  }
+  remove(cachePath.c_str());
+
+  VGLight vg;
+  CuAssertTrue(testCase, !GraphCache::load(vg, cachePath, inputPath));
+  vg.loadGraph(inputPath);
+  GraphCache::save(vg, cachePath, inputPath);
+  VGLight cached;
+  CuAssertTrue(testCase, GraphCache::load(cached, cachePath, inputPath));
+
+  CuAssertTrue(testCase, cached.getNodeTable().size() == 5);
+  CuAssertTrue(testCase, cached.getNumEdges() == 5);
+  for (int64_t i = 1; i <= 5; ++i)
+  {
+    const Node* node = cached.getNode(i * 7);
+    CuAssertTrue(testCase, node != NULL);
+    CuAssertTrue(testCase, node->sequence() == vg.getNode(i * 7)->sequence());
+    VGLight::EdgeSpan outs = cached.getOutEdges(node);
+    VGLight::EdgeSpan ins = cached.getInEdges(node);
+    CuAssertTrue(testCase, outs.size() == 1 && ins.size() == 1);
+    CuAssertTrue(testCase, outs[0]->to() == vg.getOutEdges(
+                   vg.getNode(i * 7))[0]->to());
+    CuAssertTrue(testCase, outs[0]->to_end() == (i == 3));
+    CuAssertTrue(testCase, ins[0]->from() == vg.getInEdges(
+                   vg.getNode(i * 7))[0]->from());
+  }
+  const VGLight::StepList& steps = vg.getPath("path");
+  const VGLight::StepList& cachedSteps = cached.getPath("path");
+  CuAssertTrue(testCase, cachedSteps.size() == steps.size());
+  for (size_t i = 0; i < steps.size(); ++i)
+  {
+    CuAssertTrue(testCase, cachedSteps[i]._node == steps[i]._node &&
+                 cachedSteps[i]._offset == steps[i]._offset &&
+                 cachedSteps[i]._length == steps[i]._length);
+  }
+  bool caught = false;
+  string dna;
+  try
+  {
+    cached.getPathDNA("path", dna);
+  }
+  catch(runtime_error& e)
+  {
+    caught = true;
+  }
+  CuAssertTrue(testCase, caught);
+
+  // a damaged cache (first step's node index out of range) is a miss
+  {
+    string cacheBytes;
+    {
+      ifstream cacheStream(cachePath.c_str(), ios::binary);
+      cacheBytes.assign(istreambuf_iterator<char>(cacheStream),
+                        istreambuf_iterator<char>());
+    }
+    size_t pos = cacheBytes.rfind(string((const char*)&steps[0],
+                                         sizeof(VGLight::PathStep)));
+    CuAssertTrue(testCase, pos != string::npos);
+    uint32_t badNode = 0x7fffffff;
+    memcpy(&cacheBytes[pos], &badNode, sizeof(badNode));
+    ofstream cacheStream(cachePath.c_str(), ios::binary);
+    cacheStream.write(cacheBytes.data(), cacheBytes.length());
+  }
+  CuAssertTrue(testCase, !GraphCache::load(cached, cachePath, inputPath));
+  CuAssertTrue(testCase, cached.getNodeTable().empty());
+
+  // changing the input invalidates the cache
+  {
+    ofstream inputStream(inputPath.c_str(), ios::binary | ios::app);
+    inputStream << '\0';
+  }
+  CuAssertTrue(testCase, !GraphCache::load(cached, cachePath, inputPath));
+  CuAssertTrue(testCase, cached.getNodeTable().empty());
+
+  // so does a cache that can't be mapped
+  remove(cachePath.c_str());
+  CuAssertTrue(testCase, mkdir(cachePath.c_str(), 0755) == 0);
+  CuAssertTrue(testCase, !GraphCache::load(cached, cachePath, inputPath));
+  rmdir(cachePath.c_str());
+
+  // a graph loaded with a path filter can't be cached
+  PathFilter filter;
+  filter.addName("path");
+  vg.setPathFilter(filter);
+  caught = false;
+  try
+  {
+    GraphCache::save(vg, cachePath, inputPath);
+  }
+  catch(runtime_error& e)
+  {
+    caught = true;
+  }
+  CuAssertTrue(testCase, caught);
+  remove(inputPath.c_str());
+  remove(cachePath.c_str());
+}
+
+///////////////////////////////////////////////////////////
+//  Path Filter Test
+//    - only paths matching a name or regex get loaded
+///////////////////////////////////////////////////////////
+void pathFilterTest(CuTest *testCase)
+{
+  Graph graph;
+  Node* node = graph.add_node();
+  node->set_id(1);
+  node->set_sequence("ACGT");
+  const char* names[5] = {"ref", "sample1#1", "sample1#2", "sample2#1",
+                          "xsample1#1"};
+  for (int i = 0; i < 5; ++i)
+  {
+    Path* path = graph.add_path();
+    path->set_name(names[i]);
+    Mapping* mapping = path->add_mapping();
+    mapping->set_rank(1);
+    mapping->mutable_position()->set_node_id(1);
+  }
+
+  PathFilter filter;
+  filter.addName("ref");
+  filter.addRegex("sample1#.*");
+  VGLight vg;
+  vg.setPathFilter(filter);
+  vg.loadGraph(graph);
+  const VGLight::PathMap& paths = vg.getPathMap();
+  CuAssertTrue(testCase, paths.size() == 3);
+  CuAssertTrue(testCase, paths.find("ref") != paths.end());
+  CuAssertTrue(testCase, paths.find("sample1#1") != paths.end());
+  CuAssertTrue(testCase, paths.find("sample1#2") != paths.end());
+  
+  vg.setPathFilter(PathFilter());
+  vg.loadGraph(graph);
+  CuAssertTrue(testCase, vg.getPathMap().empty());
+
+  vg.clearPathFilter();
+  vg.loadGraph(graph);
+  CuAssertTrue(testCase, vg.getPathMap().size() == 5);
+  filter = PathFilter();
+  filter.addRegex("sample2.*|ref");
+  vg.setPathFilter(filter);
+  vg.filterPaths();
+  CuAssertTrue(testCase, vg.getPathMap().size() == 2);
+  CuAssertTrue(testCase, paths.find("sample2#1") != paths.end());
+
+  bool caught = false;
+  try
+  {
+    filter.addRegex("sample(");
+  }
+  catch(runtime_error& e)
+  {
+    caught = true;
+  }
+  CuAssertTrue(testCase, caught);
+}
+
+///////////////////////////////////////////////////////////
+//  GFA Test
+//    - segments, links, paths and walks read from GFA text
+//    - fragmented walks get their own names, repeated names fail
+///////////////////////////////////////////////////////////
+void gfaTest(CuTest *testCase)
+{
+  string inputPath = "gfaTest.gfa";
+  {
+    ofstream inputStream(inputPath.c_str());
+    inputStream << "H\tVN:Z:1.1\n"
+                << "S\t1\tACGT\n"
+                << "S\t2\tGG\tLN:i:2\n"
+                << "S\t3\tTTA\r\n"
+                << "L\t1\t+\t2\t-\t0M\n"
+                << "L\t2\t-\t3\t+\t*\n"
+                << "P\tp1\t1+,2-,3+\t*\n"
+                << "W\tsample\t1\tchr1\t0\t9\t<3>2>1\n"
+                << "W\tsample\t2\tchr1\t0\t0\t*\n";
+  }
+  VGLight vg;
+  vg.setNumThreads(2);
+  vg.loadGraph(inputPath);
+  remove(inputPath.c_str());
+
+  CuAssertTrue(testCase, vg.getNodeTable().size() == 3);
+  CuAssertTrue(testCase, vg.getNode(2)->sequence() == "GG");
+  CuAssertTrue(testCase, vg.getNode(3)->sequence() == "TTA");
+  CuAssertTrue(testCase, vg.getNumEdges() == 2);
+  const Edge* edge = vg.getEdge(1, 2, false, true);
+  CuAssertTrue(testCase, edge != NULL);
+  CuAssertTrue(testCase, vg.getEdge(2, 3, true, false) != NULL);
+  CuAssertTrue(testCase, vg.getPathMap().size() == 2);
+  string dna;
+  vg.getPathDNA("p1", dna);
+  CuAssertTrue(testCase, dna == "ACGTCCTTA");
+  vg.getPathDNA("sample#1#chr1", dna);
+  CuAssertTrue(testCase, dna == "TAAGGACGT");
+
+  Graph graph;
+  const char* badLine = "S\tchr1\tACGT\n";
+  bool caught = false;
+  try
+  {
+    GFAReader::parseBlock(badLine, badLine + strlen(badLine), NULL, graph);
+  }
+  catch(runtime_error& e)
+  {
+    caught = true;
+  }
+  CuAssertTrue(testCase, caught);
+
+  // the pieces of a fragmented haplotype are kept apart
+  {
+    ofstream inputStream(inputPath.c_str());
+    inputStream << "S\t1\tACG\n"
+                << "S\t2\tTTT\n"
+                << "S\t3\tCCA\n"
+                << "S\t4\tGGC\n"
+                << "W\tsmp\t1\tchr1\t0\t6\t>1>2\n"
+                << "W\tsmp\t1\tchr1\t10\t16\t>3>4\n";
+  }
+  vg.loadGraph(inputPath);
+  CuAssertTrue(testCase, vg.getPathMap().size() == 2);
+  vg.getPathDNA("smp#1#chr1", dna);
+  CuAssertTrue(testCase, dna == "ACGTTT");
+  vg.getPathDNA("smp#1#chr1:10-16", dna);
+  CuAssertTrue(testCase, dna == "CCAGGC");
+
+  // but a name can't be used twice, by P or W lines
+  const char* repeats[2] = {"P\tp1\t1+\t*\nP\tp1\t2+\t*\n",
+                            "W\tsmp\t1\tchr1\t0\t3\t>1\n"
+                            "P\tsmp#1#chr1\t2+\t*\n"};
+  for (int i = 0; i < 2; ++i)
+  {
+    {
+      ofstream inputStream(inputPath.c_str());
+      inputStream << "S\t1\tACG\n" << "S\t2\tTTT\n" << repeats[i];
+    }
+    caught = false;
+    try
+    {
+      vg.loadGraph(inputPath);
+    }
+    catch(runtime_error& e)
+    {
+      caught = true;
+    }
+    CuAssertTrue(testCase, caught);
+  }
+  remove(inputPath.c_str());
+}
+
+///////////////////////////////////////////////////////////
+//  Multi File Test
+//    - graph split across files is merged, checking shared nodes
+//    - a GFA path name can only be used in one file
+///////////////////////////////////////////////////////////
+void multiFileTest(CuTest *testCase)
+{
+  const char* names[3] = {"multiFileTest1.gfa", "multiFileTest2.gfa",
+                          "multiFileTest3.gfa"};
+  const char* contents[3] = {
+    "S\t1\tACGT\nS\t2\tGG\nL\t1\t+\t2\t+\t*\nP\tpa\t1+,2+\t*\n",
+    "S\t2\tGG\nS\t3\tTTA\nL\t2\t+\t3\t-\t*\nP\tpb\t2+,3-\t*\n",
+    "S\t3\tTTT\n"};
+  vector<string> paths;
+  for (int i = 0; i < 3; ++i)
+  {
+    ofstream inputStream(names[i]);
+    inputStream << contents[i];
+    paths.push_back(names[i]);
+  }
+
+  for (int packed = 0; packed < 2; ++packed)
+  {
+    VGLight vg;
+    vg.setPackedSequences(packed == 1);
+    vg.setNumThreads(2);
+    vg.loadGraphs(vector<string>(paths.begin(), paths.begin() + 2));
+    CuAssertTrue(testCase, vg.getNodeTable().size() == 3);
+    CuAssertTrue(testCase, vg.getNumEdges() == 2);
+    CuAssertTrue(testCase, vg.getEdge(2, 3, false, true) != NULL);
+    CuAssertTrue(testCase, vg.getPathMap().size() == 2);
+    string dna;
+    vg.getPathDNA("pa", dna);
+    CuAssertTrue(testCase, dna == "ACGTGG");
+    vg.getPathDNA("pb", dna);
+    CuAssertTrue(testCase, dna == "GGTAA");
+
+    // node 3 has a different sequence in the third file
+    bool caught = false;
+    try
+    {
+      vg.loadGraphs(paths);
+    }
+    catch(runtime_error& e)
+    {
+      caught = true;
+    }
+    CuAssertTrue(testCase, caught);
+    CuAssertTrue(testCase, vg.getNodeTable().empty());
+  }
+
+  // a GFA path can't be continued in another file
+  {
+    ofstream inputStream(names[2]);
+    inputStream << "S\t3\tTTA\nP\tpa\t3+\t*\n";
+  }
+  VGLight vg;
+  vg.setNumThreads(2);
+  bool caught = false;
+  try
+  {
+    vg.loadGraphs(paths);
+  }
+  catch(runtime_error& e)
+  {
+    caught = true;
+  }
+  CuAssertTrue(testCase, caught);
+  CuAssertTrue(testCase, vg.getNodeTable().empty());
+  for (int i = 0; i < 3; ++i)
+  {
+    remove(names[i]);
+  }
+}
+
+///////////////////////////////////////////////////////////
+//  Graph Decoder Test
+//    - wire decoder agrees with the generated parser, skipping
+//      fields we don't use
+//    - a chunk neither can parse is an error in the pipeline
+///////////////////////////////////////////////////////////
+void graphDecoderTest(CuTest *testCase)
+{
+  Graph graph;
+  for (int64_t i = 1; i <= 3; ++i)
+  {
+    Node* node = graph.add_node();
+    node->set_id(i == 2 ? -i : i * 1000000000000LL);
+    node->set_sequence(string(i * 100, 'G'));
+    node->set_name("node");
+    node->set_data("data");
+    (*node->mutable_metadata()->mutable_info())["key"].set_str("value");
+  }
+  Edge* edge = graph.add_edge();
+  edge->set_from(-2);
+  edge->set_to(3000000000000LL);
+  edge->set_to_end(true);
+  edge->set_data("data");
+  Path* path = graph.add_path();
+  path->set_name("path");
+  for (int64_t i = 0; i < 4; ++i)
+  {
+    Mapping* mapping = path->add_mapping();
+    mapping->set_rank(i + 1);
+    mapping->mutable_position()->set_node_id(i == 2 ? -2 : i + 1);
+    mapping->mutable_position()->set_offset(i);
+    mapping->mutable_position()->set_is_reverse(i % 2 == 1);
+    if (i > 0)
+    {
+      Edit* edit = mapping->add_edit();
+      edit->set_from_length(i);
+      edit->set_to_length(i);
+      edit = mapping->add_edit();
+      edit->set_from_length(2);
+      edit->set_to_length(i == 2 ? 1 : 2);
+      edit->set_sequence(i == 3 ? "AC" : "");
+    }
+  }
+  graph.add_path()->set_name("empty");
+
+  string bytes;
+  graph.SerializeToString(&bytes);
+  GraphDecoder decoded;
+  CuAssertTrue(testCase, decoded.decode(bytes.data(), bytes.length()));
+  GraphDecoder loaded;
+  loaded.load(graph);
+
+  CuAssertTrue(testCase, decoded.getNodes().size() == 3);
+  for (size_t i = 0; i < 3; ++i)
+  {
+    const GraphDecoder::NodeRecord& n1 = decoded.getNodes()[i];
+    const GraphDecoder::NodeRecord& n2 = loaded.getNodes()[i];
+    CuAssertTrue(testCase, n1._id == n2._id);
+    CuAssertTrue(testCase, string(n1._sequence, n1._length) ==
+                 string(n2._sequence, n2._length));
+  }
+  CuAssertTrue(testCase, decoded.getEdges().size() == 1);
+  const GraphDecoder::EdgeRecord& e = decoded.getEdges()[0];
+  CuAssertTrue(testCase, e._from == -2 && e._to == 3000000000000LL &&
+               !e._fromStart && e._toEnd);
+  CuAssertTrue(testCase, decoded.getPaths().size() == 2);
+  CuAssertTrue(testCase, decoded.getPaths()[1]._numMappings == 0);
+  CuAssertTrue(testCase, string(decoded.getPaths()[0]._name,
+                                decoded.getPaths()[0]._nameLength) == "path");
+  CuAssertTrue(testCase, decoded.getMappings().size() == 4);
+  for (size_t i = 0; i < 4; ++i)
+  {
+    const GraphDecoder::MappingRecord& m1 = decoded.getMappings()[i];
+    const GraphDecoder::MappingRecord& m2 = loaded.getMappings()[i];
+    CuAssertTrue(testCase, m1._rank == m2._rank &&
+                 m1._nodeID == m2._nodeID &&
+                 m1._offset == m2._offset &&
+                 m1._reverse == m2._reverse &&
+                 m1._length == m2._length &&
+                 m1._editError == m2._editError);
+  }
+  CuAssertTrue(testCase, decoded.getMappings()[0]._length == -1);
+  CuAssertTrue(testCase, decoded.getMappings()[1]._length == 3);
+  CuAssertTrue(testCase, decoded.getMappings()[2]._editError ==
+               GraphDecoder::EditLengthMismatch);
+  CuAssertTrue(testCase, decoded.getMappings()[3]._editError ==
+               GraphDecoder::EditSequence);
+  CuAssertTrue(testCase, string(decoded.getMappings()[3]._editSequence,
+                                decoded.getMappings()[3]._editSequenceLength)
+               == "AC");
+
+  // truncated and group-encoded input is left to the generated parser
+  CuAssertTrue(testCase, !decoded.decode(bytes.data(), bytes.length() - 1));
+  const char group[2] = {(char)((1 << 3) | 3), (char)((1 << 3) | 4)};
+  CuAssertTrue(testCase, !decoded.decode(group, 2));
+
+  // and if that fails too, the pipeline gives an error in its place
+  ChunkPipeline pipeline(2);
+  string chunk = bytes;
+  pipeline.push(chunk);
+  pipeline.push(bytes.data(), bytes.length() - 1);
+  pipeline.close();
+  CuAssertTrue(testCase, pipeline.pop() != NULL);
+  bool caught = false;
+  try
+  {
+    pipeline.pop();
+  }
+  catch(runtime_error& e)
+  {
+    caught = true;
+  }
+  CuAssertTrue(testCase, caught);
+}
+
+///////////////////////////////////////////////////////////
+//  Inflate Stream Test
+//    - concatenated gzip members read through a small ring
+//    - zlib input inflated
+//    - uncompressed input passed through, even if it looks
+//      like a zlib header
+//    - truncated input is an error
+///////////////////////////////////////////////////////////
+void inflateStreamTest(CuTest *testCase)
+{
+  string text;
+  for (size_t i = 0; i < 100000; ++i)
+  {
+    text += "ACGT"[(i * 7919) % 13 % 4];
+  }
+  string compressed;
+  for (int member = 0; member < 2; ++member)
+  {
+    StringOutputStream stringStream(&compressed);
+    GzipOutputStream gzipStream(&stringStream);
+    CodedOutputStream codedStream(&gzipStream);
+    codedStream.WriteString(text);
+  }
+
+  stringstream in(compressed);
+  string out;
+  {
+    InflateStream inflateStream(in, 2, 4096);
+    const void* data;
+    int size;
+    while (inflateStream.Next(&data, &size))
+    {
+      CuAssertTrue(testCase, size > 0);
+      if (size > 10)
+      {
+        out.append((const char*)data, size - 10);
+        inflateStream.BackUp(10);
+        CuAssertTrue(testCase, inflateStream.Next(&data, &size));
+        CuAssertTrue(testCase, size == 10);
+      }
+      out.append((const char*)data, size);
+    }
+    CuAssertTrue(testCase, inflateStream.ByteCount() == 2 * text.length());
+  }
+  CuAssertTrue(testCase, out == text + text);
+
+  // uncompressed input is passed through
+  stringstream raw(text);
+  out.clear();
+  {
+    InflateStream inflateStream(raw, 2, 4096);
+    const void* data;
+    int size;
+    while (inflateStream.Next(&data, &size))
+    {
+      out.append((const char*)data, size);
+    }
+  }
+  CuAssertTrue(testCase, out == text);
+
+  // as is zlib
+  string zlibCompressed;
+  {
+    StringOutputStream stringStream(&zlibCompressed);
+    GzipOutputStream::Options options;
+    options.format = GzipOutputStream::ZLIB;
+    GzipOutputStream zlibStream(&stringStream, options);
+    CodedOutputStream codedStream(&zlibStream);
+    codedStream.WriteString(text);
+  }
+  stringstream zlibIn(zlibCompressed);
+  out.clear();
+  {
+    InflateStream inflateStream(zlibIn, 2, 4096);
+    const void* data;
+    int size;
+    while (inflateStream.Next(&data, &size))
+    {
+      out.append((const char*)data, size);
+    }
+  }
+  CuAssertTrue(testCase, out == text);
+
+  // an uncompressed vg stream whose first two bytes (8 graphs of 29
+  // bytes) happen to make a valid zlib header
+  string rawVG;
+  {
+    StringOutputStream stringStream(&rawVG);
+    CodedOutputStream codedStream(&stringStream);
+    codedStream.WriteVarint64(8);
+    for (int64_t i = 1; i <= 8; ++i)
+    {
+      Graph graph;
+      Node* node = graph.add_node();
+      node->set_id(i);
+      while (graph.ByteSizeLong() < 29)
+      {
+        node->mutable_sequence()->push_back('A');
+      }
+      string bytes;
+      graph.SerializeToString(&bytes);
+      codedStream.WriteVarint32(bytes.length());
+      codedStream.WriteString(bytes);
+    }
+  }
+  CuAssertTrue(testCase, rawVG[0] == 0x08 && rawVG[1] == 0x1d);
+  stringstream rawVGStream(rawVG);
+  VGLight vg;
+  vg.loadGraph(rawVGStream);
+  CuAssertTrue(testCase, vg.getNodeTable().size() == 8);
+
+  stringstream truncated(compressed.substr(0, compressed.length() / 4));
+  InflateStream inflateStream(truncated, 2, 4096);
+  bool caught = false;
+  try
+  {
+    const void* data;
+    int size;
+    while (inflateStream.Next(&data, &size));
+  }
+  catch(runtime_error& e)
+  {
+    caught = true;
+  }
+  CuAssertTrue(testCase, caught);
+}
+
+///////////////////////////////////////////////////////////
+//  Output Pipe Test
+//    - what's written to the pipe path ends up in the destination,
+//      and the pipe is gone afterwards
+//    - a pipe that's never opened gives an empty destination
+//    - a destination that can't be opened throws
+///////////////////////////////////////////////////////////
+void outputPipeTest(CuTest *testCase)
+{
+  string destPath = "outputPipeTest.txt";
+  string text;
+  for (int i = 0; i < 100000; ++i)
+  {
+    text += "ACGT\n";
+  }
+
+  OutputPipe pipe;
+  pipe.open(destPath);
+  string pipePath = pipe.getPath();
+  {
+    ofstream pipeStream(pipePath.c_str());
+    pipeStream << text;
+  }
+  pipe.close();
+  struct stat st;
+  CuAssertTrue(testCase, stat(pipePath.c_str(), &st) != 0);
+  {
+    ifstream destStream(destPath.c_str());
+    string copied((istreambuf_iterator<char>(destStream)),
+                  istreambuf_iterator<char>());
+    CuAssertTrue(testCase, copied == text);
+  }
+
+  pipe.open(destPath);
+  pipePath = pipe.getPath();
+  pipe.close();
+  CuAssertTrue(testCase, stat(pipePath.c_str(), &st) != 0);
+  CuAssertTrue(testCase, stat(destPath.c_str(), &st) == 0 &&
+               st.st_size == 0);
+  remove(destPath.c_str());
+
+  bool caught = false;
+  try
+  {
+    pipe.open("outputPipeTest/missing/dir.txt");
+  }
+  catch(runtime_error& e)
+  {
+    caught = true;
+  }
+  CuAssertTrue(testCase, caught);
+}
+
+///////////////////////////////////////////////////////////
+//  Compact IDs Test
+//    - nodes renumbered in primary path then topological order,
+//      with edges, paths and dangling edges following along
+//    - original ids can be looked up both ways
+///////////////////////////////////////////////////////////
+void compactIDsTest(CuTest *testCase)
+{
+  Graph graph;
+  int64_t ids[4] = {100, 7, 50, 30};
+  const char* seqs[4] = {"ACGT", "GG", "TTT", "C"};
+  for (int i = 0; i < 4; ++i)
+  {
+    Node* node = graph.add_node();
+    node->set_id(ids[i]);
+    node->set_sequence(seqs[i]);
+  }
+  int64_t edges[4][2] = {{50, 7}, {7, 100}, {30, 50}, {100, 999}};
+  for (int i = 0; i < 4; ++i)
+  {
+    Edge* edge = graph.add_edge();
+    edge->set_from(edges[i][0]);
+    edge->set_to(edges[i][1]);
+  }
+  Path* path = graph.add_path();
+  path->set_name("ref");
+  for (int i = 0; i < 2; ++i)
+  {
+    Mapping* mapping = path->add_mapping();
+    mapping->set_rank(i + 1);
+    mapping->mutable_position()->set_node_id(i == 0 ? 50 : 7);
+  }
+
+  VGLight vg;
+  vg.loadGraph(graph);
+  CuAssertTrue(testCase, !vg.hasCompactIDs());
+  CuAssertTrue(testCase, vg.getOriginalID(50) == 50);
+  vg.compactNodeIDs("ref");
+  CuAssertTrue(testCase, vg.hasCompactIDs());
+
+  // path first, then 30 (no in edges) before 100
+  int64_t order[4] = {50, 7, 30, 100};
+  for (int i = 0; i < 4; ++i)
+  {
+    CuAssertTrue(testCase, vg.getNodeTable().getNode(i).id() == i);
+    CuAssertTrue(testCase, vg.getOriginalID(i) == order[i]);
+    CuAssertTrue(testCase, vg.getCompactID(order[i]) == i);
+  }
+  CuAssertTrue(testCase, vg.getNode(0)->sequence() == "TTT");
+  CuAssertTrue(testCase, vg.getOriginalID(4) == 999);
+  CuAssertTrue(testCase, vg.getCompactID(999) == 4);
+  CuAssertTrue(testCase, vg.getCompactID(8) == -1);
+
+  CuAssertTrue(testCase, vg.getNumEdges() == 4);
+  CuAssertTrue(testCase, vg.getEdge(0, 1, false, false) != NULL);
+  CuAssertTrue(testCase, vg.getEdge(1, 3, false, false) != NULL);
+  CuAssertTrue(testCase, vg.getEdge(2, 0, false, false) != NULL);
+  CuAssertTrue(testCase, vg.getEdge(3, 4, false, false) != NULL);
+  CuAssertTrue(testCase, vg.getEdge(50, 7, false, false) == NULL);
+  CuAssertTrue(testCase, vg.getInEdges(vg.getNode(0)).size() == 1);
+  CuAssertTrue(testCase, vg.getOutEdges(vg.getNode(3)).size() == 1);
+
+  const VGLight::StepList& steps = vg.getPath("ref");
+  CuAssertTrue(testCase, steps.size() == 2);
+  CuAssertTrue(testCase, steps[0]._node == 0 && steps[1]._node == 1);
+  string dna;
+  vg.getPathDNA("ref", dna);
+  CuAssertTrue(testCase, dna == "TTTGG");
+}
+
+CuSuite* vgLightTestSuite(void) 
+{
+  CuSuite* suite = CuSuiteNew();
+  SUITE_ADD_TEST(suite, nodeTableTest);
+  SUITE_ADD_TEST(suite, adjacencyTest);
+  SUITE_ADD_TEST(suite, pathStepTest);
+  SUITE_ADD_TEST(suite, chunkedPathTest);
+  SUITE_ADD_TEST(suite, packedSequenceTest);
+  SUITE_ADD_TEST(suite, reverseComplementTest);
+  SUITE_ADD_TEST(suite, graphCacheTest);
+  SUITE_ADD_TEST(suite, pathFilterTest);
+  SUITE_ADD_TEST(suite, gfaTest);
+  SUITE_ADD_TEST(suite, multiFileTest);
+  SUITE_ADD_TEST(suite, graphDecoderTest);
+  SUITE_ADD_TEST(suite, inflateStreamTest);
+  SUITE_ADD_TEST(suite, outputPipeTest);
+  SUITE_ADD_TEST(suite, compactIDsTest);
+  return suite;
+}
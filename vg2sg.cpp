@@ -12,19 +12,30 @@
 #include <getopt.h>
 #include <sstream>
 #include <stdexcept>
+#include <vector>
+#include <algorithm>
+#include <dirent.h>
+#include <sys/stat.h>
 
-#include "pathmapper.h"
+#include "vg2sgconverter.h"
+#include "graphcache.h"
 #include "vgsgsql.h"
 
 using namespace std;
 
 void help(char** argv)
 {
-  cerr << "usage: " << argv[0] << " <graph.vg> <out.fa> <out.sql> [options]\n"
+  cerr << "usage: " << argv[0] << " <graph.vg> [graph2.vg ...] <out.fa> "
+       << "<out.sql> [options]\n"
        << "args:\n"
-       << "    graph.vg:  Input VG graph to convert\n"
+       << "    graph.vg:  Input VG graph to convert (read as GFA if it\n"
+       << "               has a .gfa extension).  If more than one is\n"
+       << "               given, or a directory (of .vg and .gfa files),\n"
+       << "               they are read in parallel and merged.  Use -\n"
+       << "               to read a VG stream from stdin.\n"
        << "    out.fa  :  Output Side Graph sequences file in FASTA format\n"
        << "    out.sql :  Output Side Graph SQL inserts file\n"
+       << "               (either output can be - for stdout)\n"
        << "options:\n"
        << "    -h, --help         \n"
        << "    -p, --primaryPath  Primary path name\n"
@@ -32,18 +43,35 @@ void help(char** argv)
        << "                       to make sure entire graph gets converted.\n"
        << "    -i, --ignorePaths  Ignore paths in input VG.  Use spanning\n"
        << "                       paths only for conversion.\n"
+       << "    -t, --threads      Number of threads to use when reading\n"
+       << "                       input and mapping paths\n"
+       << "                       [default = number of cores]\n"
+       << "    -c, --compact      Store node sequences 2-bit packed to\n"
+       << "                       save memory on large graphs.\n"
+       << "    -f, --pathFilter   Only load paths whose names match this\n"
+       << "                       regular expression (plus the primary\n"
+       << "                       path, if given).  Others are skipped\n"
+       << "                       as the input is read.\n"
+       << "    -r, --reorder      Renumber nodes 0 to n-1 in primary path\n"
+       << "                       then topological order before converting\n"
+       << "                       (faster on graphs with scattered ids).\n"
+       << "    -C, --cache        Keep a binary copy of the loaded graph in\n"
+       << "                       <graph.vg>.vg2sg and read it instead of\n"
+       << "                       the input on later runs (as long as the\n"
+       << "                       input doesn't change).\n"
        << endl;
 }
 
-/** Check if a path has edits.  Spit warning to stderr and return false
- *  if it does */
-static bool checkPath(const VGLight& vglight,
-                      const std::string& name,
-                      const VGLight::MappingList& mappings,
-                      bool span);
+/** Expand any directories in the input arguments into the graph files
+ *  they contain (sorted by name) */
+static void getInputPaths(const vector<string>& args,
+                          vector<string>& paths);
 
 int main(int argc, char** argv)
 {
+  // an output on stdout is copied into cout in big blocks, which don't
+  // need to go through stdio as well
+  ios::sync_with_stdio(false);
   if (argc < 4)
   {
     help(argv);
@@ -53,6 +81,11 @@ int main(int argc, char** argv)
   string primaryPathName;
   bool span = false;
   bool ignorePaths = false;
+  int numThreads = 0;
+  bool compact = false;
+  bool useCache = false;
+  bool reorder = false;
+  string pathRegex;
   optind = 1;
   while (true)
   {
@@ -61,10 +94,16 @@ int main(int argc, char** argv)
          {"help", no_argument, 0, 'h'},
          {"primaryPath", required_argument, 0, 'p'},
          {"span", no_argument, 0, 's'},
-         {"ignorePaths", no_argument, 0, 'i'}
+         {"ignorePaths", no_argument, 0, 'i'},
+         {"threads", required_argument, 0, 't'},
+         {"compact", no_argument, 0, 'c'},
+         {"cache", no_argument, 0, 'C'},
+         {"pathFilter", required_argument, 0, 'f'},
+         {"reorder", no_argument, 0, 'r'},
+         {0, 0, 0, 0}
        };
     int option_index = 0;
-    int c = getopt_long(argc, argv, "hp:si", long_options, &option_index);
+    int c = getopt_long(argc, argv, "hp:sit:cCf:r", long_options, &option_index);
 
     if (c == -1)
     {
@@ -87,142 +126,182 @@ int main(int argc, char** argv)
       ignorePaths = true;
       span = true;
       break;      
+    case 't':
+      numThreads = atoi(optarg);
+      break;
+    case 'c':
+      compact = true;
+      break;
+    case 'C':
+      useCache = true;
+      break;
+    case 'f':
+      pathRegex = optarg;
+      break;
+    case 'r':
+      reorder = true;
+      break;
     default:
       abort();
     }
   }
   
-  string vgPath = argv[optind++];
-  string outFaPath = argv[optind++];
-  string outSQLPath = argv[optind];
-
-  ifstream vgStream(vgPath.c_str());
-  if (!vgStream)
+  if (argc - optind < 3)
   {
-    throw runtime_error(string("Error opening " + vgPath));
+    help(argv);
+    return 1;
   }
-  
-  VGLight vglight;
-  cout << "Reading input graph from disk" << endl;
-  vglight.loadGraph(vgStream);
-  if (ignorePaths)
+  vector<string> inputArgs(argv + optind, argv + argc - 2);
+  string outFaPath = argv[argc - 2];
+  string outSQLPath = argv[argc - 1];
+  vector<string> vgPaths;
+  getInputPaths(inputArgs, vgPaths);
+  if (vgPaths.empty())
   {
-    vglight.deletePaths();
+    throw runtime_error("No input graphs found");
   }
-  cout << "Graph has " << vglight.getNodeSet().size() << " nodes, "
-       << vglight.getNumEdges() << " edges and "
-       << vglight.getPathMap().size() << " paths";
-  size_t numMappings = 0;
-  for (VGLight::PathMap::const_iterator i = vglight.getPathMap().begin();
-       i != vglight.getPathMap().end(); ++i)
+  string vgPath = vgPaths[0];
+  string inputNames = vgPath;
+  for (size_t i = 1; i < vgPaths.size(); ++i)
   {
-    numMappings += i->second.size();
+    inputNames += " " + vgPaths[i];
   }
-  cout << " with a total of " << numMappings << " mappings." << endl;
-
-  const VGLight::PathMap& paths = vglight.getPathMap();
-  
-  if (primaryPathName.length() > 0)
+  if (count(vgPaths.begin(), vgPaths.end(), "-") > 1)
   {
-    if (paths.find(primaryPathName) == paths.end())
-    {
-      throw runtime_error(string("Primary path ") + primaryPathName +
-                          string(" not found in vg"));
-    }
+    throw runtime_error("stdin (-) can only be read once");
   }
-  else if (!paths.empty())
+  if (outFaPath == "-" && outSQLPath == "-")
   {
-    primaryPathName = paths.begin()->first;
+    throw runtime_error("Only one of the outputs can go to stdout (-)");
+  }
+  if (useCache && (vgPaths.size() > 1 || vgPath == "-"))
+  {
+    cerr << "Warning: --cache is only supported for a single input file"
+         << endl;
+    useCache = false;
+  }
+  // keep stdout clean if an output is going there.  it's written from
+  // another thread then, so logging mustn't flush it either
+  ostream& log = outFaPath == "-" || outSQLPath == "-" ? cerr : cout;
+  if (&log == &cerr)
+  {
+    cerr.tie(NULL);
   }
-  
-  PathMapper pm;
-  pm.init(&vglight);
 
-  if (!primaryPathName.empty())
+  VGLight vglight;
+  if (numThreads > 0)
   {
-    cout << "Adding (primary) VG path: " << primaryPathName << endl;
-    if (checkPath(vglight, primaryPathName,
-                  vglight.getPath(primaryPathName), span))
-    {
-      pm.addPath(primaryPathName, vglight.getPath(primaryPathName));
-    }
-    else
+    vglight.setNumThreads(numThreads);
+  }
+  vglight.setPackedSequences(compact);
+
+  // don't bother loading paths we're not going to use
+  PathFilter pathFilter;
+  bool filterPaths = ignorePaths || !pathRegex.empty();
+  if (!ignorePaths && !pathRegex.empty())
+  {
+    pathFilter.addRegex(pathRegex);
+    if (!primaryPathName.empty())
     {
-      vglight.removePath(primaryPathName);
+      pathFilter.addName(primaryPathName);
     }
   }
-  else if (!span)
+  if (filterPaths)
   {
-    assert(paths.empty());
-    throw runtime_error("No paths to convert using default logic.  Use "
-                        "--span option to convert entire graph with inferred"
-                        " spanning paths.");
+    vglight.setPathFilter(pathFilter);
   }
   
-  for (VGLight::PathMap::const_iterator i = paths.begin(); i != paths.end();)
+  string cachePath = GraphCache::getCachePath(vgPath);
+  if (useCache && GraphCache::load(vglight, cachePath, vgPath))
   {
-    VGLight::PathMap::const_iterator next = i;
-    ++next;
-    if (i->first != primaryPathName)
+    log << "Read input graph from cache " << cachePath << endl;
+  }
+  else
+  {
+    // the cache always gets every path, so filter after writing it
+    if (useCache)
     {
-      cout << "Adding VG path: " << i->first << endl;
-      if (checkPath(vglight, i->first, i->second, span))
+      vglight.clearPathFilter();
+    }
+    log << "Reading input graph from " << (vgPath == "-" ? "stdin" : "disk")
+        << endl;
+    vglight.loadGraphs(vgPaths);
+    if (useCache)
+    {
+      log << "Writing graph cache " << cachePath << endl;
+      try
+      {
+        GraphCache::save(vglight, cachePath, vgPath);
+      }
+      catch(runtime_error& e)
       {
-        pm.addPath(i->first, i->second);
+        cerr << "Warning: " << e.what() << endl;
       }
-      else
+      if (filterPaths)
       {
-        vglight.removePath(i->first);
+        vglight.setPathFilter(pathFilter);
+        vglight.filterPaths();
       }
     }
-    i = next;
   }
-  if (span == true)
+  log << "Graph has " << vglight.getNodeTable().size() << " nodes, "
+      << vglight.getNumEdges() << " edges and "
+      << vglight.getPathMap().size() << " paths";
+  size_t numMappings = 0;
+  for (VGLight::PathMap::const_iterator i = vglight.getPathMap().begin();
+       i != vglight.getPathMap().end(); ++i)
   {
-    cout << "Adding set of paths that span all remaining VG edges" << endl;
-    pm.addSpanningPaths();
+    numMappings += i->second.size();
   }
-  pm.verifyPaths();
+  log << " with a total of " << numMappings << " mappings." << endl;
 
+  VG2SGConverter converter;
+  converter.setPrimaryPath(primaryPathName);
+  converter.setSpan(span);
+  converter.setReorder(reorder);
+  converter.setNumThreads(vglight.getNumThreads());
+  converter.setLog(&log);
+  converter.convert(&vglight);
 
   VGSGSQL sqlWriter;
-  sqlWriter.exportGraph(&pm, outSQLPath, outFaPath, vgPath);
+  sqlWriter.exportGraph(converter.getPathMapper(), outSQLPath, outFaPath,
+                         inputNames);
 
-  //cout << "side graph = " << *pm.getSideGraph() << endl;
+  //cout << "side graph = " << *converter.getSideGraph() << endl;
   
   
 }
 
-/** Check if a path has edits.  Spit warning to stderr and return false
- *  if it does */
-bool checkPath(const VGLight& vglight,
-               const string& name,
-               const VGLight::MappingList& mappings,
-               bool span)
+void getInputPaths(const vector<string>& args, vector<string>& paths)
 {
-  try
+  paths.clear();
+  for (size_t i = 0; i < args.size(); ++i)
   {
-    // this is rather wasteful, but does the job.
-    // can make smarter check function if performance comes up
-    // as issue...
-    string buffer;
-    vglight.getPathDNA(mappings, buffer);
-  }
-  catch(runtime_error e)
-  {
-    if (span == true)
+    struct stat info;
+    if (stat(args[i].c_str(), &info) != 0 || !S_ISDIR(info.st_mode))
+    {
+      paths.push_back(args[i]);
+      continue;
+    }
+    DIR* dir = opendir(args[i].c_str());
+    if (dir == NULL)
     {
-      cerr << "Warning: Skipping path " << name << " because: "
-           << e.what() << endl;
+      throw runtime_error("Error opening directory " + args[i]);
     }
-    else
+    vector<string> dirPaths;
+    for (struct dirent* entry = readdir(dir); entry != NULL;
+         entry = readdir(dir))
     {
-      stringstream msg;
-      msg << e.what() << " -- NOTE: This error can be turned into a "
-          << "warning by using the --span option.";
-      throw runtime_error(msg.str());
+      string name = entry->d_name;
+      size_t dot = name.rfind('.');
+      string extension = dot == string::npos ? "" : name.substr(dot);
+      if (extension == ".vg" || extension == ".gfa" || extension == ".GFA")
+      {
+        dirPaths.push_back(args[i] + "/" + name);
+      }
     }
-    return false;
+    closedir(dir);
+    sort(dirPaths.begin(), dirPaths.end());
+    paths.insert(paths.end(), dirPaths.begin(), dirPaths.end());
   }
-  return true;
 }
@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2015 by Glenn Hickey (hickey@soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.cactus
+ */
+
+#include <sstream>
+#include <stdexcept>
+#include <cassert>
+
+#include "vg2sgconverter.h"
+
+using namespace std;
+
+VG2SGConverter::VG2SGConverter() : _span(false), _reorder(false),
+                                   _numThreads(1), _log(NULL)
+{
+}
+
+VG2SGConverter::~VG2SGConverter()
+{
+}
+
+void VG2SGConverter::setPrimaryPath(const string& name)
+{
+  _primaryPath = name;
+}
+
+void VG2SGConverter::setSpan(bool span)
+{
+  _span = span;
+}
+
+void VG2SGConverter::setReorder(bool reorder)
+{
+  _reorder = reorder;
+}
+
+void VG2SGConverter::setNumThreads(size_t numThreads)
+{
+  _numThreads = numThreads;
+}
+
+void VG2SGConverter::setLog(ostream* log)
+{
+  _log = log;
+}
+
+void VG2SGConverter::convert(VGLight* vg)
+{
+  assert(vg != NULL);
+  const VGLight::PathMap& paths = vg->getPathMap();
+  string primaryPathName = _primaryPath;
+  _usedPrimaryPath.clear();
+
+  if (primaryPathName.length() > 0)
+  {
+    if (paths.find(primaryPathName) == paths.end())
+    {
+      throw runtime_error(string("Primary path ") + primaryPathName +
+                          string(" not found in vg"));
+    }
+  }
+  else if (!paths.empty())
+  {
+    primaryPathName = paths.begin()->first;
+  }
+
+  if (_reorder && !vg->hasCompactIDs())
+  {
+    if (_log != NULL)
+    {
+      *_log << "Renumbering nodes" << endl;
+    }
+    vg->compactNodeIDs(primaryPathName);
+  }
+
+  _pathMapper.init(vg);
+  _pathMapper.setNumThreads(_numThreads);
+
+  if (!primaryPathName.empty())
+  {
+    if (_log != NULL)
+    {
+      *_log << "Adding (primary) VG path: " << primaryPathName << endl;
+    }
+    if (checkPath(*vg, primaryPathName))
+    {
+      _pathMapper.addPath(primaryPathName, vg->getPath(primaryPathName));
+      _usedPrimaryPath = primaryPathName;
+    }
+    else
+    {
+      vg->removePath(primaryPathName);
+    }
+  }
+  else if (!_span)
+  {
+    assert(paths.empty());
+    throw runtime_error("No paths to convert using default logic.  Use "
+                        "--span option to convert entire graph with inferred"
+                        " spanning paths.");
+  }
+
+  for (VGLight::PathMap::const_iterator i = paths.begin(); i != paths.end();)
+  {
+    VGLight::PathMap::const_iterator next = i;
+    ++next;
+    if (i->first != primaryPathName)
+    {
+      if (_log != NULL)
+      {
+        *_log << "Adding VG path: " << i->first << endl;
+      }
+      if (checkPath(*vg, i->first))
+      {
+        _pathMapper.addPath(i->first, i->second);
+      }
+      else
+      {
+        vg->removePath(i->first);
+      }
+    }
+    i = next;
+  }
+  if (_span == true)
+  {
+    if (_log != NULL)
+    {
+      *_log << "Adding set of paths that span all remaining VG edges" << endl;
+    }
+    _pathMapper.addSpanningPaths();
+  }
+  _pathMapper.resolvePaths();
+  _pathMapper.verifyPaths();
+}
+
+bool VG2SGConverter::checkPath(const VGLight& vg, const string& name) const
+{
+  try
+  {
+    // this is rather wasteful, but does the job.
+    // can make smarter check function if performance comes up
+    // as issue...
+    // (errors found when the path was loaded are thrown by name)
+    string buffer;
+    vg.getPathDNA(name, buffer);
+  }
+  catch(runtime_error& e)
+  {
+    if (_span == true)
+    {
+      cerr << "Warning: Skipping path " << name << " because: "
+           << e.what() << endl;
+    }
+    else
+    {
+      stringstream msg;
+      msg << e.what() << " -- NOTE: This error can be turned into a "
+          << "warning by using the --span option.";
+      throw runtime_error(msg.str());
+    }
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2015 by Glenn Hickey (hickey@soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.cactus
+ */
+
+#ifndef _VG2SGCONVERTER_H
+#define _VG2SGCONVERTER_H
+
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include "vglight.h"
+#include "pathmapper.h"
+
+/*
+ * Library entry point (libvg2sg.a) for the whole conversion, for code
+ * that wants the Side Graph in memory rather than in FASTA and SQL
+ * files.  Load a VGLight however is convenient (from files, or straight
+ * from Graph messages the caller already has, see
+ * VGLight::loadGraphChunks()), then:
+ *
+ *   VG2SGConverter converter;
+ *   converter.setPrimaryPath("ref");
+ *   converter.convert(&vglight);
+ *   const SideGraph* sg = converter.getSideGraph();
+ *
+ * The results belong to the converter, and are valid until it's
+ * destroyed or convert() is called again.  The VGLight must stay
+ * around as long as the results are used.
+ */
+class VG2SGConverter
+{
+public:
+   VG2SGConverter();
+   ~VG2SGConverter();
+
+   /** Primary path name.  If not set, the first path (by name) is
+    * used */
+   void setPrimaryPath(const std::string& name);
+   /** Add paths that span all the edges not covered by the input
+    * paths, and skip (rather than fail on) input paths that can't be
+    * converted (default: false) */
+   void setSpan(bool span);
+   /** Renumber the nodes before converting (see
+    * VGLight::compactNodeIDs()) (default: false) */
+   void setReorder(bool reorder);
+   /** Number of threads used to look up the side graph paths once
+    * all sequences are made (see PathMapper::setNumThreads())
+    * (default: 1) */
+   void setNumThreads(size_t numThreads);
+   /** Where to write progress messages (default: NULL, none) */
+   void setLog(std::ostream* log);
+
+   /** Convert the paths of a graph (which may be changed: paths that
+    * can't be converted are removed and nodes may be renumbered).
+    * Throws runtime_error if the conversion fails */
+   void convert(VGLight* vg);
+
+   /** Name of the primary path used by the last convert() (empty if
+    * there wasn't one) */
+   const std::string& getPrimaryPath() const;
+
+   /** Results of the last convert() */
+   const PathMapper* getPathMapper() const;
+   const SideGraph* getSideGraph() const;
+   /** number of converted paths, including any spanning paths (which
+    * come after the input paths) */
+   size_t getNumPaths() const;
+   const std::string& getPathName(sg_int_t id) const;
+   bool isSpanningPath(sg_int_t id) const;
+   const std::vector<SGSegment>& getSideGraphPath(
+     const std::string& name) const;
+   std::string getSideGraphDNA(sg_int_t seqID, sg_int_t offset = 0,
+                               sg_int_t length = -1,
+                               bool reversed = false) const;
+
+protected:
+
+   /** Check if a path can be converted.  Warn and return false if
+    * not and spanning, otherwise throw */
+   bool checkPath(const VGLight& vg, const std::string& name) const;
+
+   std::string _primaryPath;
+   std::string _usedPrimaryPath;
+   bool _span;
+   bool _reorder;
+   size_t _numThreads;
+   std::ostream* _log;
+   PathMapper _pathMapper;
+};
+
+inline const std::string& VG2SGConverter::getPrimaryPath() const
+{
+  return _usedPrimaryPath;
+}
+
+inline const PathMapper* VG2SGConverter::getPathMapper() const
+{
+  return &_pathMapper;
+}
+
+inline const SideGraph* VG2SGConverter::getSideGraph() const
+{
+  return _pathMapper.getSideGraph();
+}
+
+inline size_t VG2SGConverter::getNumPaths() const
+{
+  return _pathMapper.getNumPaths();
+}
+
+inline const std::string& VG2SGConverter::getPathName(sg_int_t id) const
+{
+  return _pathMapper.getPathName(id);
+}
+
+inline bool VG2SGConverter::isSpanningPath(sg_int_t id) const
+{
+  return _pathMapper.isSpanningPath(id);
+}
+
+inline const std::vector<SGSegment>& VG2SGConverter::getSideGraphPath(
+  const std::string& name) const
+{
+  return _pathMapper.getSideGraphPath(name);
+}
+
+inline std::string VG2SGConverter::getSideGraphDNA(sg_int_t seqID,
+                                                   sg_int_t offset,
+                                                   sg_int_t length,
+                                                   bool reversed) const
+{
+  return _pathMapper.getSideGraphDNA(seqID, offset, length, reversed);
+}
+
+#endif
@@ -6,236 +6,1081 @@
 
 #include <fstream>
 #include <sstream>
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <atomic>
+#include <queue>
+#include <functional>
 #include "google/protobuf/stubs/common.h"
 #include "google/protobuf/io/zero_copy_stream.h"
-#include "google/protobuf/io/zero_copy_stream_impl.h"
-#include "google/protobuf/io/gzip_stream.h"
 #include "google/protobuf/io/coded_stream.h"
 
 #include "vglight.h"
+#include "chunkpipeline.h"
+#include "mappedfile.h"
+#include "inflatestream.h"
+#include "gfareader.h"
 
 using namespace std;
 using namespace vg;
 using namespace google::protobuf::io;
 
-VGLight::VGLight() : _numEdges(0)
+/** how much GFA text each thread parses at a time */
+static const size_t gfaBlockSize = 1 << 24;
+
+VGLight::VGLight() : _edgeHashMask(0), _numEdges(0), _numThreads(1),
+                     _hasPathFilter(false)
 {
+  setNumThreads(thread::hardware_concurrency());
 }
 
 VGLight::~VGLight()
 {
 }
 
-/** Most code copy-pasted from VG stream constructor (vg.cpp)  and 
- * the functions it calls
- */
+void VGLight::setNumThreads(size_t numThreads)
+{
+  _numThreads = max(numThreads, (size_t)1);
+}
+
+void VGLight::setPackedSequences(bool packed)
+{
+  clear();
+  _nodes.setPacked(packed);
+}
+
 void VGLight::loadGraph(istream& in)
 {
-  ZeroCopyInputStream *raw_in = new IstreamInputStream(&in);
-  GzipInputStream *gzip_in = new GzipInputStream(raw_in);
-  CodedInputStream *coded_in = new CodedInputStream(gzip_in);
- 
-  uint64_t count;
-  coded_in->ReadVarint64(&count);
-  if (!count)
+  clear();
+
+  // one thread splits the stream into messages, the pipeline's workers
+  // parse them, and we index them here in their original order.
+  ChunkPipeline pipeline(_numThreads);
+  thread reader(&VGLight::readChunks, &in, &pipeline);
+  addChunks(pipeline, reader);
+  buildIndexes();
+}
+
+void VGLight::loadGraph(const string& path)
+{
+  clear();
+  readGraph(path);
+  buildIndexes();
+}
+
+void VGLight::loadGFA(const string& path)
+{
+  clear();
+  readGFA(path);
+  buildIndexes();
+}
+
+void VGLight::loadGraphs(const vector<string>& paths)
+{
+  clear();
+  if (paths.size() == 1)
   {
-    throw runtime_error("Empty stream");
+    readGraph(paths[0]);
+    buildIndexes();
+    return;
   }
 
-  
-  _graphs.clear();
-  
-  do
-  {
-    std::string s;
-    for (uint64_t i = 0; i < count; ++i)
-    {
-      uint32_t msgSize = 0;
-      delete coded_in;
-      coded_in = new CodedInputStream(gzip_in);
-      // the messages are prefixed by their size
-      coded_in->ReadVarint32(&msgSize);
-      if ((msgSize > 0) &&
-          (coded_in->ReadString(&s, msgSize)))
+  // each file is read into its own graph by one of a pool of threads,
+  // sharing out the rest of the threads to parse their chunks.  
+  // nothing gets indexed until all files are read.
+  size_t numWorkers = min(_numThreads, paths.size());
+  vector<VGLight*> shards(paths.size(), NULL);
+  vector<exception_ptr> errors(paths.size());
+  atomic<size_t> nextFile(0);
+  vector<thread> workers;
+  for (size_t i = 0; i < numWorkers; ++i)
+  {
+    workers.push_back(thread([&]()
+      {
+        for (size_t j = nextFile++; j < paths.size(); j = nextFile++)
+        {
+          try
+          {
+            shards[j] = new VGLight();
+            shards[j]->setNumThreads(_numThreads / numWorkers);
+            shards[j]->setPackedSequences(_nodes.isPacked());
+            if (_hasPathFilter)
+            {
+              shards[j]->setPathFilter(_pathFilter);
+            }
+            shards[j]->readGraph(paths[j]);
+          }
+          catch(...)
+          {
+            errors[j] = current_exception();
+          }
+        }
+      }));
+  }
+  for (size_t i = 0; i < workers.size(); ++i)
+  {
+    workers[i].join();
+  }
+
+  // merge in the order the files were given so the result doesn't
+  // depend on which file finished first
+  try
+  {
+    for (size_t i = 0; i < paths.size(); ++i)
+    {
+      if (errors[i])
+      {
+        rethrow_exception(errors[i]);
+      }
+      addShard(*shards[i]);
+      delete shards[i];
+      shards[i] = NULL;
+    }
+    buildIndexes(true);
+  }
+  catch(...)
+  {
+    for (size_t i = 0; i < shards.size(); ++i)
+    {
+      delete shards[i];
+    }
+    clear();
+    throw;
+  }
+}
+
+void VGLight::readGraph(const string& path)
+{
+  if (GFAReader::isGFAPath(path))
+  {
+    readGFA(path);
+    return;
+  }
+  if (path == "-")
+  {
+    // can't map a pipe: stream it, in big reads
+    ChunkPipeline pipeline(_numThreads);
+    thread reader(&VGLight::readChunks, &cin, &pipeline);
+    addChunks(pipeline, reader);
+    return;
+  }
+  MappedFile file;
+  file.open(path);
+  if (file.isCompressed())
+  {
+    file.close();
+    ifstream vgStream(path.c_str());
+    if (!vgStream)
+    {
+      throw runtime_error(string("Error opening " + path));
+    }
+    ChunkPipeline pipeline(_numThreads);
+    thread reader(&VGLight::readChunks, &vgStream, &pipeline);
+    addChunks(pipeline, reader);
+  }
+  else
+  {
+    ChunkPipeline pipeline(_numThreads);
+    thread reader(&VGLight::readMappedChunks, file.getData(), file.getSize(),
+                  &pipeline);
+    addChunks(pipeline, reader);
+  }
+}
+
+void VGLight::readGFA(const string& path)
+{
+  MappedFile file;
+  file.open(path);
+  vector<pair<const char*, const char*> > blocks;
+  GFAReader::splitBlocks(file.getData(), file.getSize(), gfaBlockSize,
+                         blocks);
+  const PathFilter* filter = _hasPathFilter ? &_pathFilter : NULL;
+
+  // parse a block per thread at a time, adding each batch in order
+  // once it's done so only a few blocks are ever in memory
+  vector<Graph> graphs(_numThreads);
+  vector<exception_ptr> errors(_numThreads);
+  // unlike protobuf chunks, each path is all on one line, so a name
+  // that comes up again would otherwise be merged into the first
+  set<string> pathNames;
+  for (size_t first = 0; first < blocks.size(); first += _numThreads)
+  {
+    size_t count = min(_numThreads, blocks.size() - first);
+    vector<thread> workers;
+    for (size_t i = 0; i < count; ++i)
+    {
+      workers.push_back(thread([&, i]()
+        {
+          try
+          {
+            graphs[i].Clear();
+            GFAReader::parseBlock(blocks[first + i].first,
+                                  blocks[first + i].second, filter,
+                                  graphs[i]);
+          }
+          catch(...)
+          {
+            errors[i] = current_exception();
+          }
+        }));
+    }
+    for (size_t i = 0; i < count; ++i)
+    {
+      workers[i].join();
+    }
+    for (size_t i = 0; i < count; ++i)
+    {
+      if (errors[i])
       {
-        Graph object; 
-        object.ParseFromString(s);
-        _graphs.push_back(object);
+        rethrow_exception(errors[i]);
       }
-    }   
-  } while (coded_in->ReadVarint64(&count));
+      for (int j = 0; j < graphs[i].path_size(); ++j)
+      {
+        if (!pathNames.insert(graphs[i].path(j).name()).second)
+        {
+          throw runtime_error("Path " + graphs[i].path(j).name() +
+                              " appears more than once in " + path);
+        }
+      }
+      addGraph(graphs[i]);
+    }
+  }
+  for (map<string, RawPath>::iterator i = _rawPaths.begin();
+       i != _rawPaths.end(); ++i)
+  {
+    i->second._oneLine = true;
+  }
+}
 
-  mergeGraphs();
+void VGLight::addChunks(ChunkPipeline& pipeline, thread& reader)
+{
+  try
+  {
+    for (const GraphDecoder* chunk = pipeline.pop(); chunk != NULL;
+         chunk = pipeline.pop())
+    {
+      addChunk(*chunk);
+    }
+  }
+  catch(...)
+  {
+    pipeline.cancel();
+    reader.join();
+    throw;
+  }
+  reader.join();
+}
+
+/** Most code copy-pasted from VG stream constructor (vg.cpp)  and 
+ * the functions it calls
+ */
+void VGLight::readChunks(istream* in, ChunkPipeline* pipeline)
+{
+  // decompression runs on a thread of its own
+  InflateStream *gzip_in = new InflateStream(*in);
+  CodedInputStream *coded_in = new CodedInputStream(gzip_in);
+
+  try
+  {
+    uint64_t count;
+    coded_in->ReadVarint64(&count);
+    if (!count)
+    {
+      throw runtime_error("Empty stream");
+    }
+  
+    bool cancelled = false;
+    do
+    {
+      std::string s;
+      for (uint64_t i = 0; i < count && !cancelled; ++i)
+      {
+        uint32_t msgSize = 0;
+        delete coded_in;
+        coded_in = new CodedInputStream(gzip_in);
+        // the messages are prefixed by their size
+        coded_in->ReadVarint32(&msgSize);
+        if ((msgSize > 0) &&
+            (coded_in->ReadString(&s, msgSize)))
+        {
+          cancelled = !pipeline->push(s);
+        }
+      }   
+    } while (!cancelled && coded_in->ReadVarint64(&count));
+    pipeline->close();
+  }
+  catch(...)
+  {
+    pipeline->fail(current_exception());
+  }
 
   delete coded_in;
   delete gzip_in;
-  delete raw_in;
+}
+
+/** read a varint off a buffer, returning false if it runs past the end */
+static bool readVarint(const unsigned char*& pos, const unsigned char* end,
+                       uint64_t& value)
+{
+  value = 0;
+  for (int shift = 0; pos < end && shift < 64; shift += 7)
+  {
+    unsigned char byte = *pos++;
+    value |= (uint64_t)(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+void VGLight::readMappedChunks(const char* data, size_t size,
+                               ChunkPipeline* pipeline)
+{
+  try
+  {
+    // same framing as readChunks: groups of size-prefixed messages,
+    // each group prefixed by its message count
+    const unsigned char* pos = (const unsigned char*)data;
+    const unsigned char* end = pos + size;
+    uint64_t count = 0;
+    if (!readVarint(pos, end, count) || !count)
+    {
+      throw runtime_error("Empty stream");
+    }
+    bool cancelled = false;
+    do
+    {
+      for (uint64_t i = 0; i < count && !cancelled; ++i)
+      {
+        uint64_t msgSize = 0;
+        if (!readVarint(pos, end, msgSize) || msgSize > (size_t)(end - pos))
+        {
+          throw runtime_error("Truncated stream");
+        }
+        if (msgSize > 0)
+        {
+          cancelled = !pipeline->push((const char*)pos, msgSize);
+        }
+        pos += msgSize;
+      }
+    } while (!cancelled && readVarint(pos, end, count));
+    pipeline->close();
+  }
+  catch(...)
+  {
+    pipeline->fail(current_exception());
+  }
 }
 
 void VGLight::loadGraph(const Graph& graph)
 {
-  _graphs.resize(1);
-  _graphs[0] = graph;
-  mergeGraphs();
+  clear();
+  addGraph(graph);
+  buildIndexes();
 }
 
-void VGLight::deletePaths()
+void VGLight::loadGraphChunks(const vector<const Graph*>& chunks)
 {
-  _paths.clear();
+  clear();
+  // one decoder for all the chunks, so its record arrays get reused
+  GraphDecoder decoded;
+  for (size_t i = 0; i < chunks.size(); ++i)
+  {
+    decoded.load(*chunks[i]);
+    addChunk(decoded);
+  }
+  buildIndexes();
 }
 
-void VGLight::mergeGraphs()
+void VGLight::clear()
 {
   _paths.clear();
   _nodes.clear();
-  _fromEdges.clear();
-  _toEdges.clear();
+  _edgeStore.clear();
+  _edges.clear();
+  _outOffsets.clear();
+  _outEdges.clear();
+  _inOffsets.clear();
+  _inEdges.clear();
+  _edgeHash.clear();
+  _edgeHashMask = 0;
+  _rawPaths.clear();
+  _pathErrors.clear();
   _numEdges = 0;
+  _originalIDs.clear();
+  _compactIDs.clear();
+}
+
+void VGLight::setPathFilter(const PathFilter& filter)
+{
+  _pathFilter = filter;
+  _hasPathFilter = true;
+  _pathFilterResults.clear();
+}
+
+void VGLight::clearPathFilter()
+{
+  _pathFilter = PathFilter();
+  _hasPathFilter = false;
+  _pathFilterResults.clear();
+}
+
+bool VGLight::passesPathFilter(const string& name)
+{
+  if (!_hasPathFilter)
+  {
+    return true;
+  }
+  map<string, bool>::iterator i = _pathFilterResults.find(name);
+  if (i == _pathFilterResults.end())
+  {
+    i = _pathFilterResults.insert(
+      pair<string, bool>(name, _pathFilter.matches(name))).first;
+  }
+  return i->second;
+}
+
+void VGLight::filterPaths()
+{
+  for (PathMap::iterator i = _paths.begin(); i != _paths.end();)
+  {
+    PathMap::iterator next = i;
+    ++next;
+    if (!passesPathFilter(i->first))
+    {
+      _pathErrors.erase(i->first);
+      _paths.erase(i);
+    }
+    i = next;
+  }
+}
+
+void VGLight::deletePaths()
+{
+  _paths.clear();
+  _pathErrors.clear();
+}
+
+void VGLight::compactNodeIDs(const string& primaryPath)
+{
+  assert(!hasCompactIDs());
+  vector<size_t> order;
+  getCompactOrder(primaryPath, order);
+  vector<size_t> newIndex(order.size());
+  _originalIDs.resize(order.size());
+  for (size_t i = 0; i < order.size(); ++i)
+  {
+    newIndex[order[i]] = i;
+    _originalIDs[i] = _nodes.getNode(order[i]).id();
+  }
+
+  // edges can point to nodes that aren't there, which need new ids too
+  // (that can't be confused with those of real nodes)
+  map<int64_t, int64_t> missingIDs;
+  for (size_t i = 0; i < _edges.size(); ++i)
+  {
+    int64_t ids[2] = {_edges[i].from(), _edges[i].to()};
+    for (int j = 0; j < 2; ++j)
+    {
+      if (_nodes.getIndex(ids[j]) < 0 && missingIDs.count(ids[j]) == 0)
+      {
+        missingIDs[ids[j]] = 0;
+      }
+    }
+  }
+  for (map<int64_t, int64_t>::iterator i = missingIDs.begin();
+       i != missingIDs.end(); ++i)
+  {
+    i->second = _originalIDs.size();
+    _originalIDs.push_back(i->first);
+  }
+  for (size_t i = 0; i < _edges.size(); ++i)
+  {
+    Edge& edge = _edges[i];
+    int64_t from = _nodes.getIndex(edge.from());
+    int64_t to = _nodes.getIndex(edge.to());
+    edge.set_from(from >= 0 ? newIndex[from] : missingIDs[edge.from()]);
+    edge.set_to(to >= 0 ? newIndex[to] : missingIDs[edge.to()]);
+  }
+  _compactIDs.resize(_originalIDs.size());
+  for (size_t i = 0; i < _originalIDs.size(); ++i)
+  {
+    _compactIDs[i] = pair<int64_t, int64_t>(_originalIDs[i], i);
+  }
+  sort(_compactIDs.begin(), _compactIDs.end());
 
-  for (size_t i = 0; i < _graphs.size(); ++i)
+  _nodes.renumber(order);
+  buildAdjacency();
+  buildEdgeIndex();
+  for (PathMap::iterator i = _paths.begin(); i != _paths.end(); ++i)
   {
-    for (size_t j = 0; j < _graphs[i].node_size(); ++j)
+    for (StepList::iterator j = i->second.begin(); j != i->second.end(); ++j)
     {
-      _nodes.insert(_graphs[i].mutable_node(j));
+      j->_node = newIndex[j->_node];
     }
-    for (size_t j = 0; j < _graphs[i].edge_size(); ++j)
+  }
+}
+
+void VGLight::getCompactOrder(const string& primaryPath,
+                              vector<size_t>& order) const
+{
+  size_t numNodes = _nodes.size();
+  order.clear();
+  order.reserve(numNodes);
+  vector<bool> placed(numNodes, false);
+  // number of in edges from nodes that haven't been placed yet
+  vector<size_t> inDegree(numNodes);
+  for (size_t i = 0; i < numNodes; ++i)
+  {
+    EdgeSpan inEdges = getInEdges(i);
+    for (size_t j = 0; j < inEdges.size(); ++j)
     {
-      const Edge* edge = _graphs[i].mutable_edge(j);
-      _fromEdges.insert(pair<int64_t, const Edge*>(edge->from(), edge));
-      _toEdges.insert(pair<int64_t, const Edge*>(edge->to(), edge));
-      ++_numEdges;
+      inDegree[i] += _nodes.getIndex(inEdges[j]->from()) >= 0 ? 1 : 0;
     }
-    for (size_t j = 0; j < _graphs[i].path_size(); ++j)
+  }
+  // lowest index (ie original id) first
+  priority_queue<size_t, vector<size_t>, greater<size_t> > ready;
+  auto place = [&](size_t index)
     {
-      Path* path = _graphs[i].mutable_path(j);
-      pair<PathMap::iterator, bool> ret = _paths.insert(
-        pair<string, MappingList>(path->name(), MappingList()));
-      for (size_t k = 0; k < path->mapping_size(); ++k)
+      placed[index] = true;
+      order.push_back(index);
+      EdgeSpan outEdges = getOutEdges(index);
+      for (size_t j = 0; j < outEdges.size(); ++j)
       {
-        ret.first->second.push_back(path->mapping(k));
+        int64_t to = _nodes.getIndex(outEdges[j]->to());
+        if (to >= 0 && !placed[to] && --inDegree[to] == 0)
+        {
+          ready.push(to);
+        }
       }
-      // sort by rank and remove dupes
-      set<Mapping, MappingRankLess> mappingSet(ret.first->second.begin(),
-                                               ret.first->second.end());
-      if (mappingSet.size() > 1 || mappingSet.begin()->rank() > 0)
+    };
+
+  PathMap::const_iterator path = _paths.find(primaryPath);
+  if (path != _paths.end())
+  {
+    for (size_t i = 0; i < path->second.size(); ++i)
+    {
+      if (!placed[path->second[i]._node])
       {
-        ret.first->second = MappingList(mappingSet.begin(), mappingSet.end());
+        place(path->second[i]._node);
       }
-      else
+    }
+  }
+  for (size_t i = 0; i < numNodes; ++i)
+  {
+    if (!placed[i] && inDegree[i] == 0)
+    {
+      ready.push(i);
+    }
+  }
+  // Kahn's algorithm, breaking cycles at the lowest unplaced node
+  for (size_t next = 0; order.size() < numNodes;)
+  {
+    if (ready.empty())
+    {
+      while (placed[next])
       {
-        cerr << "Warning: rank not specified for mapping in path "
-             << path->name() << endl;
+        ++next;
       }
+      ready.push(next);
+    }
+    size_t index = ready.top();
+    ready.pop();
+    if (!placed[index])
+    {
+      place(index);
     }
   }
 }
 
-void VGLight::getInEdges(const Node* node, 
-                         vector<const Edge*>& ins) const
+int64_t VGLight::getCompactID(int64_t originalID) const
+{
+  if (_compactIDs.empty())
+  {
+    return _nodes.getIndex(originalID) >= 0 ? originalID : -1;
+  }
+  vector<pair<int64_t, int64_t> >::const_iterator i = lower_bound(
+    _compactIDs.begin(), _compactIDs.end(),
+    pair<int64_t, int64_t>(originalID, 0));
+  return i != _compactIDs.end() && i->first == originalID ? i->second : -1;
+}
+
+void VGLight::addGraph(const Graph& graph)
 {
-  ins.clear();
-  pair<EdgeMap::const_iterator, EdgeMap::const_iterator> ret;
+  GraphDecoder decoded;
+  decoded.load(graph);
+  addChunk(decoded);
+}
 
-  ret = _toEdges.equal_range(node->id());
-  for (EdgeMap::const_iterator i = ret.first; i != ret.second; ++i)
+void VGLight::addChunk(const GraphDecoder& chunk)
+{
+  const vector<GraphDecoder::NodeRecord>& nodes = chunk.getNodes();
+  for (size_t j = 0; j < nodes.size(); ++j)
+  {
+    _nodes.addNode(nodes[j]._id, string(nodes[j]._sequence,
+                                        nodes[j]._length));
+  }
+  const vector<GraphDecoder::EdgeRecord>& edges = chunk.getEdges();
+  for (size_t j = 0; j < edges.size(); ++j)
   {
-    ins.push_back(i->second);
+    _edgeStore.push_back(Edge());
+    Edge* edge = &_edgeStore.back();
+    edge->set_from(edges[j]._from);
+    edge->set_to(edges[j]._to);
+    edge->set_from_start(edges[j]._fromStart);
+    edge->set_to_end(edges[j]._toEnd);
+    ++_numEdges;
+  }
+  const vector<GraphDecoder::PathRecord>& paths = chunk.getPaths();
+  const vector<GraphDecoder::MappingRecord>& mappings = chunk.getMappings();
+  for (size_t j = 0; j < paths.size(); ++j)
+  {
+    string name(paths[j]._name, paths[j]._nameLength);
+    if (!passesPathFilter(name))
+    {
+      continue;
+    }
+    RawPath& rawPath = _rawPaths[name];
+    RawStepList& steps = rawPath._steps;
+    size_t runStart = steps.size();
+    for (size_t k = paths[j]._firstMapping;
+         k < paths[j]._firstMapping + paths[j]._numMappings; ++k)
+    {
+      RawStep step;
+      string error;
+      if (makeRawStep(mappings[k], step, error) == true)
+      {
+        steps.push_back(step);
+      }
+      else
+      {
+        addPathError(name, mappings[k]._rank, error);
+      }
+    }
+    // each chunk's mappings become a sorted run.  they're usually in
+    // order already, so check before sorting
+    if (steps.size() > runStart)
+    {
+      if (!is_sorted(steps.begin() + runStart, steps.end(),
+                     RawStepRankLess()))
+      {
+        stable_sort(steps.begin() + runStart, steps.end(),
+                    RawStepRankLess());
+      }
+      rawPath._runEnds.push_back(steps.size());
+    }
+    for (size_t k = runStart; k < steps.size() && !rawPath._ranked; ++k)
+    {
+      rawPath._ranked = steps[0]._rank > 0 || steps[k]._rank != steps[0]._rank;
+    }
+    // (nothing to say about a chunk whose mappings were all rejected)
+    if (!rawPath._ranked && steps.size() > runStart)
+    {
+      cerr << "Warning: rank not specified for mapping in path "
+           << name << endl;
+    }
   }
 }
 
-void VGLight::getOutEdges(const Node* node, 
-                         vector<const Edge*>& outs) const
+void VGLight::addShard(VGLight& shard)
 {
-  outs.clear();
-  pair<EdgeMap::const_iterator, EdgeMap::const_iterator> ret;
+  _nodes.addNodes(shard._nodes);
+  for (deque<Edge>::iterator i = shard._edgeStore.begin();
+       i != shard._edgeStore.end(); ++i)
+  {
+    _edgeStore.push_back(Edge());
+    _edgeStore.back().Swap(&*i);
+  }
+  _numEdges += shard._numEdges;
+  shard._edgeStore.clear();
+  for (map<string, RawPath>::iterator i = shard._rawPaths.begin();
+       i != shard._rawPaths.end(); ++i)
+  {
+    // a path that's split across files gets one more run per file.
+    // but GFA paths are whole, and their ranks always start at 1, so
+    // merging another copy would silently drop most of one of them
+    map<string, RawPath>::iterator found = _rawPaths.find(i->first);
+    if (found != _rawPaths.end() &&
+        (found->second._oneLine || i->second._oneLine))
+    {
+      throw runtime_error("Path " + i->first +
+                          " appears in more than one input file");
+    }
+    RawPath& rawPath = _rawPaths[i->first];
+    size_t runStart = rawPath._steps.size();
+    rawPath._steps.insert(rawPath._steps.end(), i->second._steps.begin(),
+                          i->second._steps.end());
+    for (size_t j = 0; j < i->second._runEnds.size(); ++j)
+    {
+      rawPath._runEnds.push_back(runStart + i->second._runEnds[j]);
+    }
+    rawPath._ranked = rawPath._ranked || i->second._ranked;
+    rawPath._oneLine = i->second._oneLine;
+  }
+  shard._rawPaths.clear();
+  for (map<string, pair<int64_t, string> >::iterator i =
+          shard._pathErrors.begin(); i != shard._pathErrors.end(); ++i)
+  {
+    addPathError(i->first, i->second.first, i->second.second);
+  }
+  shard._pathErrors.clear();
+}
 
-  ret = _fromEdges.equal_range(node->id());
-  for (EdgeMap::const_iterator i = ret.first; i != ret.second; ++i)
+bool VGLight::makeRawStep(const GraphDecoder::MappingRecord& mapping,
+                          RawStep& step, string& error)
+{
+  step._rank = mapping._rank;
+  step._nodeID = mapping._nodeID;
+  step._offset = mapping._offset;
+  step._reverse = mapping._reverse;
+  // no edits: -1 means distance from offset to end of node
+  // has edits: take total length of edits (???)
+  step._length = mapping._length;
+  if (mapping._editError == GraphDecoder::EditLengthMismatch)
   {
-    outs.push_back(i->second);
+    stringstream msg;
+    msg << "Nontrivial edit found: to_length != from_length";
+    error = msg.str();
+    return false;
   }
+  else if (mapping._editError == GraphDecoder::EditSequence)
+  {
+    stringstream msg;
+    msg << "Nontrivial edit found: sequence="
+        << string(mapping._editSequence, mapping._editSequenceLength)
+        << " (only empty sequence supported)";
+    error = msg.str();
+    return false;
+  }
+  return true;
 }
 
-void VGLight::getPathDNA(const string& pathName, string& outDNA) const
+void VGLight::addPathError(const string& name, int64_t rank,
+                           const string& error)
 {
-  assert(_paths.find(pathName) != _paths.end());
-  const MappingList& mappingList = _paths.find(pathName)->second;
-  getPathDNA(mappingList, outDNA);
+  map<string, pair<int64_t, string> >::iterator i = _pathErrors.find(name);
+  if (i == _pathErrors.end() || rank < i->second.first)
+  {
+    _pathErrors[name] = pair<int64_t, string>(rank, error);
+  }
 }
 
-void VGLight::getPathDNA(const MappingList& mappingList, string& outDNA) const
+void VGLight::buildIndexes(bool checkNodes)
 {
-  outDNA.erase();
-  for (MappingList::const_iterator i = mappingList.begin();
-       i != mappingList.end(); ++i)
-  {
-    const Position& pos = i->position();
-    bool reversed = i->position().is_reverse();
-    const Node* node = getNode(pos.node_id());
-    int64_t segmentLength = getSegmentLength(*i);
-    int64_t offset = pos.offset();
-    if (reversed)
-    {
-      // line below is to move to newer vg where offset is relative to end when reversed:
-      offset = getNode(i->position().node_id())->sequence().length() - 1 - offset;
-      
-      offset -= segmentLength - 1;
+  _nodes.index(checkNodes);
+  buildAdjacency();
+  buildEdgeIndex();
+  buildPaths();
+}
+
+void VGLight::buildAdjacency()
+{
+  // restage anything from a previous call so it gets resorted too
+  for (size_t i = 0; i < _edges.size(); ++i)
+  {
+    _edgeStore.push_front(Edge());
+    _edgeStore.front().Swap(&_edges[_edges.size() - 1 - i]);
+  }
+  
+  // counting sort of edges by source node index (stable, so edges
+  // keep their input order within a node).  edges whose nodes aren't
+  // in the graph go at the end and aren't in the adjacency.
+  size_t numNodes = _nodes.size();
+  vector<size_t> fromIndex(_edgeStore.size());
+  _outOffsets.assign(numNodes + 2, 0);
+  for (size_t i = 0; i < _edgeStore.size(); ++i)
+  {
+    int64_t index = _nodes.getIndex(_edgeStore[i].from());
+    fromIndex[i] = index >= 0 ? index : numNodes;
+    ++_outOffsets[fromIndex[i] + 1];
+  }
+  for (size_t i = 1; i < _outOffsets.size(); ++i)
+  {
+    _outOffsets[i] += _outOffsets[i - 1];
+  }
+  _edges.clear();
+  _edges.resize(_edgeStore.size());
+  vector<size_t> next(_outOffsets.begin(), _outOffsets.end() - 1);
+  for (size_t i = 0; i < _edgeStore.size(); ++i)
+  {
+    _edges[next[fromIndex[i]]++].Swap(&_edgeStore[i]);
+  }
+  _edgeStore.clear();
+  _outOffsets.resize(numNodes + 1);
+  _outEdges.resize(_outOffsets.back());
+  for (size_t i = 0; i < _outEdges.size(); ++i)
+  {
+    _outEdges[i] = &_edges[i];
+  }
+
+  // same thing, by target node, for the in edges
+  vector<int64_t> toIndex(_edges.size());
+  _inOffsets.assign(numNodes + 1, 0);
+  for (size_t i = 0; i < _edges.size(); ++i)
+  {
+    toIndex[i] = _nodes.getIndex(_edges[i].to());
+    if (toIndex[i] >= 0)
+    {
+      ++_inOffsets[toIndex[i] + 1];
     }
-    string dna = node->sequence().substr(offset, segmentLength);
-    if (reversed)
+  }
+  for (size_t i = 1; i < _inOffsets.size(); ++i)
+  {
+    _inOffsets[i] += _inOffsets[i - 1];
+  }
+  _inEdges.resize(_inOffsets.back());
+  next.assign(_inOffsets.begin(), _inOffsets.end() - 1);
+  for (size_t i = 0; i < _edges.size(); ++i)
+  {
+    if (toIndex[i] >= 0)
     {
-      reverseComplement(dna);
+      _inEdges[next[toIndex[i]]++] = &_edges[i];
     }
-    outDNA += dna;
   }
 }
 
-int64_t VGLight::getSegmentLength(const Mapping& mapping) const
+void VGLight::buildEdgeIndex()
 {
-  int64_t segmentLength = 0;
-  // no edits: take distance from offset to end of node
-  if (mapping.edit_size() == 0)
+  // keep load factor under 1/2
+  size_t capacity = 1024;
+  while (capacity < 2 * _outEdges.size())
   {
-    const Position& pos = mapping.position();
-    const Node* node = getNode(pos.node_id());
-    int64_t offset = pos.offset();
-    if (pos.is_reverse()) {
-      // convert to old-style forward offset
-      offset = node->sequence().length() - 1 - offset;
+    capacity *= 2;
+  }
+  _edgeHash.assign(capacity, -1);
+  _edgeHashMask = capacity - 1;
+  for (size_t i = 0; i < _outEdges.size(); ++i)
+  {
+    const Edge* edge = _outEdges[i];
+    size_t j = hashEdge(edge->from(), edge->to(), edge->from_start(),
+                        edge->to_end());
+    for (; _edgeHash[j] != -1; j = (j + 1) & _edgeHashMask)
+    {
+      const Edge& other = _edges[_edgeHash[j]];
+      if (other.from() == edge->from() && other.to() == edge->to() &&
+          other.from_start() == edge->from_start() &&
+          other.to_end() == edge->to_end())
+      {
+        break;
+      }
     }
-    if (!pos.is_reverse())
+    // first copy of a duplicate edge wins, like the old scan
+    if (_edgeHash[j] == -1)
     {
-      segmentLength = node->sequence().length() - offset;
+      _edgeHash[j] = edge - &_edges[0];
     }
-    else
+  }
+}
+
+void VGLight::buildPaths()
+{
+  vector<RawPath*> rawPaths;
+  vector<StepList*> paths;
+  for (map<string, RawPath>::iterator i = _rawPaths.begin();
+       i != _rawPaths.end(); ++i)
+  {
+    rawPaths.push_back(&i->second);
+    paths.push_back(&_paths[i->first]);
+  }
+  vector<char> failed(rawPaths.size(), 0);
+  vector<int64_t> errorRanks(rawPaths.size(), 0);
+  vector<string> errors(rawPaths.size());
+
+  // workers grab the next unfinished path until there are none left
+  atomic<size_t> next(0);
+  vector<thread> workers;
+  size_t numWorkers = min(_numThreads, rawPaths.size());
+  for (size_t t = 0; t < numWorkers; ++t)
+  {
+    workers.push_back(thread([&]()
+      {
+        for (size_t i = next++; i < rawPaths.size(); i = next++)
+        {
+          failed[i] = !finishPath(*rawPaths[i], *paths[i], errorRanks[i],
+                                  errors[i]);
+        }
+      }));
+  }
+  for (size_t t = 0; t < workers.size(); ++t)
+  {
+    workers[t].join();
+  }
+
+  size_t i = 0;
+  for (map<string, RawPath>::iterator j = _rawPaths.begin();
+       j != _rawPaths.end(); ++j, ++i)
+  {
+    if (failed[i])
     {
-      segmentLength = offset + 1;
+      addPathError(j->first, errorRanks[i], errors[i]);
     }
   }
-  // has edits: take total length of edits (???)
-  else
+  _rawPaths.clear();
+}
+
+bool VGLight::finishPath(RawPath& rawPath, StepList& steps,
+                         int64_t& errorRank, string& error) const
+{
+  if (rawPath._ranked)
+  {
+    mergeRuns(rawPath);
+  }
+  bool success = true;
+  const RawStepList& rawSteps = rawPath._steps;
+  steps.clear();
+  steps.reserve(rawSteps.size());
+  for (size_t j = 0; j < rawSteps.size(); ++j)
   {
-    int numEdits = mapping.edit_size();
-    for (int i = 0; i < numEdits; ++i)
+    const RawStep& rawStep = rawSteps[j];
+    int64_t nodeIndex = _nodes.getIndex(rawStep._nodeID);
+    if (nodeIndex < 0)
     {
-      const Edit& edit = mapping.edit(i);
-      if (edit.from_length() != edit.to_length())
+      if (success || rawStep._rank < errorRank)
       {
         stringstream msg;
-        msg << "Nontrivial edit found: to_length != from_length";
-        throw runtime_error(msg.str());
+        msg << "Node " << rawStep._nodeID << " not found in graph";
+        error = msg.str();
+        errorRank = rawStep._rank;
       }
-      else if (edit.sequence().length() > 0)
+      success = false;
+      continue;
+    }
+    steps.push_back(makeStep(nodeIndex, rawStep._offset, rawStep._reverse,
+                             rawStep._length));
+  }
+  RawStepList().swap(rawPath._steps);
+  return success;
+}
+
+/** heap entry for mergeRuns: ties go to the earlier run so that the
+ * first copy of a rank read is the one kept */
+struct RunHead
+{
+   int64_t _rank;
+   size_t _run;
+   size_t _pos;
+   bool operator<(const RunHead& h) const {
+     return _rank > h._rank || (_rank == h._rank && _run > h._run);
+   }
+};
+
+void VGLight::mergeRuns(RawPath& rawPath)
+{
+  RawStepList& steps = rawPath._steps;
+  const vector<size_t>& runEnds = rawPath._runEnds;
+  
+  // no need to merge if the runs are already in order, which is the
+  // case when a path is written out in rank order over several chunks
+  bool inOrder = true;
+  for (size_t i = 1; i < runEnds.size() && inOrder; ++i)
+  {
+    inOrder = steps[runEnds[i - 1] - 1]._rank <= steps[runEnds[i - 1]]._rank;
+  }
+
+  RawStepList merged;
+  merged.reserve(steps.size());
+  if (inOrder)
+  {
+    for (size_t i = 0; i < steps.size(); ++i)
+    {
+      if (merged.empty() || steps[i]._rank != merged.back()._rank)
       {
-        stringstream msg;
-        msg << "Nontrivial edit found: sequence=" << edit.sequence()
-            << " (only empty sequence supported)";
-        throw runtime_error(msg.str());          
+        merged.push_back(steps[i]);
+      }
+    }
+  }
+  else
+  {
+    vector<RunHead> heap;
+    for (size_t i = 0; i < runEnds.size(); ++i)
+    {
+      RunHead head;
+      head._run = i;
+      head._pos = i == 0 ? 0 : runEnds[i - 1];
+      head._rank = steps[head._pos]._rank;
+      heap.push_back(head);
+    }
+    make_heap(heap.begin(), heap.end());
+    while (!heap.empty())
+    {
+      pop_heap(heap.begin(), heap.end());
+      RunHead& head = heap.back();
+      if (merged.empty() || head._rank != merged.back()._rank)
+      {
+        merged.push_back(steps[head._pos]);
+      }
+      if (++head._pos < runEnds[head._run])
+      {
+        head._rank = steps[head._pos]._rank;
+        push_heap(heap.begin(), heap.end());
+      }
+      else
+      {
+        heap.pop_back();
       }
-      segmentLength += mapping.edit(i).from_length();
     }
   }
-  return segmentLength;
+  steps.swap(merged);
+}
+
+VGLight::PathStep VGLight::makeStep(size_t nodeIndex, int64_t offset,
+                                    bool reverse, int64_t length) const
+{
+  int64_t nodeLength = _nodes.getLength(nodeIndex);
+  PathStep step;
+  step._node = nodeIndex;
+  step._reverse = reverse;
+  // (same distance on either strand, since offset is strand-relative)
+  step._length = length >= 0 ? length : nodeLength - offset;
+  // convert to old-style forward offset
+  step._offset = !reverse ? offset : nodeLength - 1 - offset;
+  return step;
+}
+
+void VGLight::getPathDNA(const string& pathName, string& outDNA) const
+{
+  assert(_paths.find(pathName) != _paths.end());
+  map<string, pair<int64_t, string> >::const_iterator error =
+     _pathErrors.find(pathName);
+  if (error != _pathErrors.end())
+  {
+    throw runtime_error(error->second.second);
+  }
+  const StepList& steps = _paths.find(pathName)->second;
+  getPathDNA(steps, outDNA);
+}
+
+void VGLight::getPathDNA(const StepList& steps, string& outDNA) const
+{
+  outDNA.erase();
+  for (StepList::const_iterator i = steps.begin(); i != steps.end(); ++i)
+  {
+    int64_t offset = i->_offset;
+    if (i->_reverse)
+    {
+      offset -= (int64_t)i->_length - 1;
+    }
+    int64_t nodeLength = _nodes.getLength(i->_node);
+    if (offset < 0 || offset > nodeLength)
+    {
+      stringstream msg;
+      msg << "Mapping on node " << getOriginalID(_nodes.getNode(i->_node).id())
+          << " starts outside of the node";
+      throw runtime_error(msg.str());
+    }
+    // decode straight onto the end of the output
+    size_t length = min((int64_t)i->_length, nodeLength - offset);
+    size_t pos = outDNA.length();
+    outDNA.resize(pos + length);
+    _nodes.getSequence(i->_node, offset, length, &outDNA[pos]);
+    if (i->_reverse)
+    {
+      reverseComplement(&outDNA[pos], length, &outDNA[pos]);
+    }
+  }
 }
 
 char VGLight::reverseComplement(char c)
@@ -255,11 +1100,14 @@ char VGLight::reverseComplement(char c)
   return c;
 }
 
-void VGLight::reverseComplement(std::string& s)
+/** reverse complement with gaps ('-') left where they are, as in 
+ * halCommon.h.  this is the reference behaviour for the kernels below,
+ * and is what we fall back on if a sequence has gaps */
+static void reverseComplementGapped(char* s, size_t length)
 {
-  if (!s.empty())
+  if (length > 0)
   {
-    size_t j = s.length() - 1;
+    size_t j = length - 1;
     size_t i = 0;
     char buf;
     do
@@ -268,7 +1116,7 @@ void VGLight::reverseComplement(std::string& s)
       {
         --j;
       }
-      while (i < s.length() - 1 && s[i] == '-')
+      while (i < length - 1 && s[i] == '-')
       {
         ++i;
       }
@@ -277,13 +1125,13 @@ void VGLight::reverseComplement(std::string& s)
       {
         if (i == j && s[i] != '-')
         {
-          s[i] = reverseComplement(s[i]);
+          s[i] = VGLight::reverseComplement(s[i]);
         }
         break;
       }
 
-      buf = reverseComplement(s[i]);
-      s[i] = reverseComplement(s[j]);
+      buf = VGLight::reverseComplement(s[i]);
+      s[i] = VGLight::reverseComplement(s[j]);
       s[j] = buf;
 
       ++i;
@@ -291,3 +1139,182 @@ void VGLight::reverseComplement(std::string& s)
     } while (true);
   }
 }
+
+/** kernels for gap-free sequences: out-of-place (in and out must not
+ * overlap) and in-place */
+typedef void (*RevCompKernel)(const char* in, size_t length, char* out);
+typedef void (*RevCompInPlaceKernel)(char* s, size_t length);
+
+static void revCompScalar(const char* in, size_t length, char* out)
+{
+  for (size_t i = 0; i < length; ++i)
+  {
+    out[i] = VGLight::reverseComplement(in[length - 1 - i]);
+  }
+}
+
+static void revCompInPlaceScalar(char* s, size_t length)
+{
+  for (size_t i = 0, j = length; i < j; ++i)
+  {
+    char buf = VGLight::reverseComplement(s[i]);
+    s[i] = VGLight::reverseComplement(s[--j]);
+    s[j] = buf;
+  }
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define VGLIGHT_SIMD_REVCOMP
+
+/* Complementing only swaps Aa<->Tt and Cc<->Gg, and leaves everything
+ * else alone.  A^T == 0x15 and C^G == 0x04 (same in lower case), so
+ * it comes down to xor-ing those bytes with the right constant.  OR-ing
+ * in 0x20 lower-cases the letters without making anything else look
+ * like one. */
+
+__attribute__((target("ssse3")))
+static inline __m128i revCompBlock16(__m128i v)
+{
+  const __m128i reverse = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8,
+                                        7, 6, 5, 4, 3, 2, 1, 0);
+  __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+  __m128i at = _mm_or_si128(_mm_cmpeq_epi8(lower, _mm_set1_epi8('a')),
+                            _mm_cmpeq_epi8(lower, _mm_set1_epi8('t')));
+  __m128i cg = _mm_or_si128(_mm_cmpeq_epi8(lower, _mm_set1_epi8('c')),
+                            _mm_cmpeq_epi8(lower, _mm_set1_epi8('g')));
+  __m128i flip = _mm_or_si128(_mm_and_si128(at, _mm_set1_epi8(0x15)),
+                              _mm_and_si128(cg, _mm_set1_epi8(0x04)));
+  return _mm_shuffle_epi8(_mm_xor_si128(v, flip), reverse);
+}
+
+__attribute__((target("ssse3")))
+static void revCompSSSE3(const char* in, size_t length, char* out)
+{
+  size_t i = 0;
+  for (; i + 16 <= length; i += 16)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i*)(in + length - i - 16));
+    _mm_storeu_si128((__m128i*)(out + i), revCompBlock16(v));
+  }
+  revCompScalar(in, length - i, out + i);
+}
+
+__attribute__((target("ssse3")))
+static void revCompInPlaceSSSE3(char* s, size_t length)
+{
+  size_t i = 0;
+  size_t j = length;
+  for (; j - i >= 32; i += 16, j -= 16)
+  {
+    __m128i front = _mm_loadu_si128((const __m128i*)(s + i));
+    __m128i back = _mm_loadu_si128((const __m128i*)(s + j - 16));
+    _mm_storeu_si128((__m128i*)(s + i), revCompBlock16(back));
+    _mm_storeu_si128((__m128i*)(s + j - 16), revCompBlock16(front));
+  }
+  revCompInPlaceScalar(s + i, j - i);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i revCompBlock32(__m256i v)
+{
+  // vpshufb only works within 128-bit lanes, so reverse each lane 
+  // then swap the lanes
+  const __m256i reverse = _mm256_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8,
+                                           7, 6, 5, 4, 3, 2, 1, 0,
+                                           15, 14, 13, 12, 11, 10, 9, 8,
+                                           7, 6, 5, 4, 3, 2, 1, 0);
+  __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+  __m256i at = _mm256_or_si256(
+    _mm256_cmpeq_epi8(lower, _mm256_set1_epi8('a')),
+    _mm256_cmpeq_epi8(lower, _mm256_set1_epi8('t')));
+  __m256i cg = _mm256_or_si256(
+    _mm256_cmpeq_epi8(lower, _mm256_set1_epi8('c')),
+    _mm256_cmpeq_epi8(lower, _mm256_set1_epi8('g')));
+  __m256i flip = _mm256_or_si256(
+    _mm256_and_si256(at, _mm256_set1_epi8(0x15)),
+    _mm256_and_si256(cg, _mm256_set1_epi8(0x04)));
+  __m256i r = _mm256_shuffle_epi8(_mm256_xor_si256(v, flip), reverse);
+  return _mm256_permute4x64_epi64(r, 0x4E);
+}
+
+__attribute__((target("avx2")))
+static void revCompAVX2(const char* in, size_t length, char* out)
+{
+  size_t i = 0;
+  for (; i + 32 <= length; i += 32)
+  {
+    __m256i v = _mm256_loadu_si256((const __m256i*)(in + length - i - 32));
+    _mm256_storeu_si256((__m256i*)(out + i), revCompBlock32(v));
+  }
+  revCompScalar(in, length - i, out + i);
+}
+
+__attribute__((target("avx2")))
+static void revCompInPlaceAVX2(char* s, size_t length)
+{
+  size_t i = 0;
+  size_t j = length;
+  for (; j - i >= 64; i += 32, j -= 32)
+  {
+    __m256i front = _mm256_loadu_si256((const __m256i*)(s + i));
+    __m256i back = _mm256_loadu_si256((const __m256i*)(s + j - 32));
+    _mm256_storeu_si256((__m256i*)(s + i), revCompBlock32(back));
+    _mm256_storeu_si256((__m256i*)(s + j - 32), revCompBlock32(front));
+  }
+  revCompInPlaceScalar(s + i, j - i);
+}
+#endif
+
+/** pick the best kernels the cpu we're running on supports */
+struct RevCompKernels
+{
+   RevCompKernels() : _outOfPlace(revCompScalar),
+                      _inPlace(revCompInPlaceScalar) {
+#ifdef VGLIGHT_SIMD_REVCOMP
+     __builtin_cpu_init();
+     if (__builtin_cpu_supports("avx2"))
+     {
+       _outOfPlace = revCompAVX2;
+       _inPlace = revCompInPlaceAVX2;
+     }
+     else if (__builtin_cpu_supports("ssse3"))
+     {
+       _outOfPlace = revCompSSSE3;
+       _inPlace = revCompInPlaceSSSE3;
+     }
+#endif
+   }
+   RevCompKernel _outOfPlace;
+   RevCompInPlaceKernel _inPlace;
+};
+
+static const RevCompKernels revCompKernels;
+
+void VGLight::reverseComplement(std::string& s)
+{
+  if (!s.empty())
+  {
+    reverseComplement(&s[0], s.length(), &s[0]);
+  }
+}
+
+void VGLight::reverseComplement(const char* in, size_t length, char* out)
+{
+  if (memchr(in, '-', length) != NULL)
+  {
+    if (out != in)
+    {
+      memcpy(out, in, length);
+    }
+    reverseComplementGapped(out, length);
+  }
+  else if (out == in)
+  {
+    revCompKernels._inPlace(out, length);
+  }
+  else
+  {
+    revCompKernels._outOfPlace(in, length, out);
+  }
+}
@@ -8,12 +8,21 @@
 #define _VGLIGHT_H
 
 #include <string>
+#include <vector>
 #include <map>
 #include <set>
-#include <list>
+#include <deque>
 #include <iostream>
 #include <stdexcept>
+#include <thread>
+#include <cassert>
 #include "vg.pb.h"
+#include "nodetable.h"
+#include "pathfilter.h"
+#include "graphdecoder.h"
+
+class ChunkPipeline;
+class GraphCache;
 
 /*
  * Lightweight wrapper to get a VG graph out of a protobuf stream.  Written
@@ -26,103 +35,344 @@ public:
    VGLight();
    virtual ~VGLight();
    
-   /** Read a graph in from a protobuf stream
+   /** Read a graph in from a protobuf stream (gzipped or not).  Each
+    * Graph chunk is indexed into our own storage as soon as it is 
+    * parsed, then freed.
+    * Chunks are parsed in parallel (see setNumThreads()) but always
+    * indexed in the order they appear in the stream.
     */
    void loadGraph(std::istream& inStream);
 
-   /** Copy in a graph
+   /** Read a graph from a file.  Gzipped files go through the stream
+    * reader above, while uncompressed files are memory mapped and 
+    * each Graph is parsed straight out of the mapped bytes.  Files 
+    * with a .gfa extension are read with loadGFA().  A path of "-"
+    * reads a protobuf stream from standard input.
+    */
+   void loadGraph(const std::string& path);
+
+   /** Read a graph from a GFA file (see GFAReader).  The file is memory
+    * mapped and split into blocks of lines that are parsed in parallel,
+    * then added in file order just like protobuf chunks */
+   void loadGFA(const std::string& path);
+
+   /** Read a graph that's split across several files (protobuf or GFA, 
+    * as above).  The files are read at the same time, one per thread
+    * (see setNumThreads()), then merged in the order given.  A node id
+    * can appear in more than one file only if it has the same sequence
+    * each time, otherwise runtime_error is thrown.
+    */
+   void loadGraphs(const std::vector<std::string>& paths);
+
+   /** Load a graph that's already in memory.  The graph is only 
+    * borrowed for the call: what's needed of it is indexed straight
+    * out of the message, without copying the message itself.
     */
    void loadGraph(const vg::Graph& graph);
 
+   /** Same as above, for a graph held as a list of chunks (as they'd
+    * come out of a vg stream).  The chunks are added in order */
+   void loadGraphChunks(const std::vector<const vg::Graph*>& chunks);
+
+   /** Clear out everything that's been loaded
+    */
+   void clear();
+
+   /** Number of threads used to parse protobuf chunks in loadGraph()
+    * (defaults to number of cores) */
+   void setNumThreads(size_t numThreads);
+   size_t getNumThreads() const;
+
+   /** Keep node sequences 2-bit packed (about a quarter of the memory)
+    * instead of in the nodes, which are then left with empty sequence
+    * strings.  Use getNodeTable().getSequence() to get at them.  
+    * Clears the graph.  (default: false) */
+   void setPackedSequences(bool packed);
+
+   /** Only load the paths that match a filter.  Other paths are 
+    * skipped as soon as they are parsed. */
+   void setPathFilter(const PathFilter& filter);
+   /** Go back to loading all paths */
+   void clearPathFilter();
+   bool hasPathFilter() const;
+
+   /** Remove any loaded paths that don't pass the path filter */
+   void filterPaths();
+
    /** Delete paths (hack to allow option to skip corrupt paths)
     */
    void deletePaths();
 
-   struct NodePtrLess {
-      bool operator()(const vg::Node* node1, const vg::Node* node2) const;
+   /** Renumber the nodes 0 to n-1, in the order they're visited by the
+    * given path (if any) then in a (weakly) topological order of the
+    * rest, so that walking a path touches the node table and everything
+    * indexed by it more or less in order.  Ties, and cycles, are broken 
+    * by lowest original id.  Edges and paths are updated to match.  
+    * Ids of missing nodes that edges point to are numbered from n on.
+    * getOriginalID() maps back to the input ids for reporting.  */
+   void compactNodeIDs(const std::string& primaryPath = "");
+   bool hasCompactIDs() const;
+   /** input id of node with given id (the same id if the graph
+    * wasn't renumbered) */
+   int64_t getOriginalID(int64_t id) const;
+   /** id of node with given input id, -1 if not there */
+   int64_t getCompactID(int64_t originalID) const;
+
+   /** One step of a path: a vg::Mapping boiled down to what the
+    * conversion needs, with lengths and offsets resolved against the
+    * node at load time.  _offset is relative to the forward strand
+    * (the old vg convention) and is the first base visited, so the
+    * step covers _offset to _offset + _length - 1 when forward and 
+    * _offset - _length + 1 to _offset when reversed.  */
+   struct PathStep {
+      uint32_t _node;    // index in node table
+      int32_t _offset;
+      uint32_t _length;
+      uint32_t _reverse;
    };
-   struct MappingRankLess {
-      bool operator()(const vg::Mapping& m1, const vg::Mapping& m2) const;
+   typedef std::vector<PathStep> StepList;
+
+   /** Allocation-free view of the edges touching a node: a contiguous
+    * run of a CSR adjacency array */
+   class EdgeSpan {
+   public:
+      typedef const vg::Edge* const* const_iterator;
+      EdgeSpan() : _begin(0), _end(0) {}
+      EdgeSpan(const_iterator b, const_iterator e) : _begin(b), _end(e) {}
+      const_iterator begin() const { return _begin; }
+      const_iterator end() const { return _end; }
+      size_t size() const { return _end - _begin; }
+      bool empty() const { return _begin == _end; }
+      const vg::Edge* operator[](size_t i) const { return _begin[i]; }
+   private:
+      const_iterator _begin;
+      const_iterator _end;
    };
-   typedef std::list<vg::Mapping> MappingList;
-   typedef std::set<const vg::Node*, NodePtrLess> NodeSet;
-   typedef std::multimap<int64_t, const vg::Edge*> EdgeMap;
-   typedef std::map<std::string, MappingList> PathMap;
+   typedef std::map<std::string, StepList> PathMap;
 
-   const NodeSet& getNodeSet() const;
+   /** all the nodes, in id order.  shared with the conversion code
+    * so that everyone can do O(1) lookups */
+   const NodeTable& getNodeTable() const;
    const PathMap& getPathMap() const;
-   const EdgeMap& getFromEdgeMap() const;
-   const EdgeMap& getToEdgeMap() const;
    size_t getNumEdges() const;
 
    const vg::Node* getNode(int64_t id) const;
    const vg::Edge* getEdge(int64_t from_id, int64_t to_id,
                            bool from_start, bool to_end) const;
-   const MappingList& getPath(const std::string& name) const;
+   /** O(1) position of an edge in [0, getNumEdges()), which stays the
+    * same as long as the graph is loaded, so it can index flat arrays
+    * of per-edge data.  -1 if the edge isn't there.  Duplicate edges
+    * all get the position of the first one */
+   int64_t getEdgeIndex(int64_t from_id, int64_t to_id,
+                        bool from_start, bool to_end) const;
+   int64_t getEdgeIndex(const vg::Edge* edge) const;
+   const StepList& getPath(const std::string& name) const;
    void removePath(const std::string& name);
 
    /* all edges that touch node in either direction */
-   void getInEdges(const vg::Node* node,
-                         std::vector<const vg::Edge*>& ins) const;
-   void getOutEdges(const vg::Node* node,
-                         std::vector<const vg::Edge*>& outs) const;
+   EdgeSpan getInEdges(const vg::Node* node) const;
+   EdgeSpan getOutEdges(const vg::Node* node) const;
+   /** same as above but by position in node table */
+   EdgeSpan getInEdges(size_t nodeIndex) const;
+   EdgeSpan getOutEdges(size_t nodeIndex) const;
 
-   /** get string for a VG path */
+   /** get string for a VG path.  throws runtime_error if the path
+    * had a mapping we can't handle (ie a nontrivial edit) */
    void getPathDNA(const std::string& name, std::string& outDNA) const;
-   void getPathDNA(const MappingList& mappingList, std::string& outDNA) const;
+   void getPathDNA(const StepList& steps, std::string& outDNA) const;
 
-   /** get length of a path segment */
-   int64_t getSegmentLength(const vg::Mapping& mapping) const;
+   /** make a path step from a vg-style (offset relative to strand)
+    * position on a node.  length -1 means to the end of the node */
+   PathStep makeStep(size_t nodeIndex, int64_t offset, bool reverse,
+                     int64_t length = -1) const;
 
    /** copied from halCommon.h -- dont want hal dep just for this*/
    static char reverseComplement(char c);
    static void reverseComplement(std::string& s);
+   /** same as above, but from one buffer to another.  in and out can
+    * be the same but must not otherwise overlap.  Uses SSSE3/AVX2
+    * when the cpu has them. */
+   static void reverseComplement(const char* in, size_t length, char* out);
    
 protected:
 
-   /** Convert _graphs into _nodes/_edges/_paths */
-   void mergeGraphs();
+   friend class GraphCache;
+
+   /** Split a protobuf stream into serialized Graph messages and feed
+    * them to the parsing pipeline.  Runs in its own thread */
+   static void readChunks(std::istream* in, ChunkPipeline* pipeline);
+
+   /** Same as above, but for an uncompressed stream that's already in
+    * memory.  Chunks are passed to the pipeline without copying */
+   static void readMappedChunks(const char* data, size_t size,
+                                ChunkPipeline* pipeline);
+
+   /** Index chunks from a pipeline until it runs dry (rethrowing any
+    * error from the reader thread, which is joined either way) */
+   void addChunks(ChunkPipeline& pipeline, std::thread& reader);
+
+   /** Add all the chunks in a file, protobuf or GFA.  Doesn't index */
+   void readGraph(const std::string& path);
+   void readGFA(const std::string& path);
+
+   /** Move everything added to another (unindexed) graph into this one,
+    * after what's already been added */
+   void addShard(VGLight& shard);
+
+   /** Copy what we need of the nodes, edges and paths of a graph chunk
+    * into our own storage (_nodes/_edgeStore/_rawPaths).  Nothing 
+    * points into the chunk afterwards, so it can be freed right away */
+   void addChunk(const GraphDecoder& chunk);
+   /** same as above but from a parsed Graph */
+   void addGraph(const vg::Graph& graph);
+
+   /** Build the lookup structures once all chunks are added.  If 
+    * checkNodes is set, throw runtime_error if the same node id was
+    * added with different sequences */
+   void buildIndexes(bool checkNodes = false);
+
+   /** Sort the edges by source node and build the CSR adjacency
+    * arrays in both directions */
+   void buildAdjacency();
+
+   /** Hash the edges in the adjacency for getEdgeIndex() */
+   void buildEdgeIndex();
+   size_t hashEdge(int64_t from_id, int64_t to_id, bool from_start,
+                   bool to_end) const;
+
+   /** Merge the raw paths and resolve them against the node table
+    * into _paths.  Paths are independent, so this is done in parallel */
+   void buildPaths();
+
+   /** Order of node table indexes for compactNodeIDs() */
+   void getCompactOrder(const std::string& primaryPath,
+                        std::vector<size_t>& order) const;
+
+   /** Path mapping as it comes off the wire.  We can't make a PathStep
+    * until all the nodes are loaded, so keep just enough to do that 
+    * later */
+   struct RawStep {
+      int64_t _rank;
+      int64_t _nodeID;
+      int64_t _offset;
+      int64_t _length; // -1 : no edits (goes to end of node)
+      bool _reverse;
+   };
+   struct RawStepRankLess {
+      bool operator()(const RawStep& s1, const RawStep& s2) const;
+   };
+   typedef std::vector<RawStep> RawStepList;
+
+   /** A path as read: one run of steps per chunk it appeared in, each
+    * run sorted by rank.  The runs are only merged once everything is
+    * loaded (see mergeRuns()) */
+   struct RawPath {
+      RawPath() : _ranked(false), _oneLine(false) {}
+      RawStepList _steps;
+      std::vector<size_t> _runEnds;
+      /** false until we see ranks that say something about the order
+       * (ie not all the same, or a single positive rank).  Unranked
+       * paths are kept in input order */
+      bool _ranked;
+      /** read from a single GFA line, so it's complete and can't be 
+       * continued in another file */
+      bool _oneLine;
+   };
+
+   /** K-way merge of the sorted runs of a raw path, removing duplicate
+    * ranks (the earliest one read wins) */
+   static void mergeRuns(RawPath& rawPath);
+
+   /** Merge a raw path then convert it into steps.  Only reads the node
+    * table, so it's safe to run on several paths at once.  Returns
+    * false if a node is missing, with the rank and reason of the first
+    * one in errorRank and error */
+   bool finishPath(RawPath& rawPath, StepList& steps, int64_t& errorRank,
+                   std::string& error) const;
+
+   /** Convert a mapping to a raw step.  Returns false if the mapping
+    * can't be converted, with the reason in error */
+   static bool makeRawStep(const GraphDecoder::MappingRecord& mapping,
+                           RawStep& step, std::string& error);
+
+   /** Check a path name against the filter (remembering the answer, 
+    * since the same paths show up in chunk after chunk) */
+   bool passesPathFilter(const std::string& name);
 
-   /** Graphs read direct from protobuf.  They are unmerged and we keep
-    * them around just for storage */
-   std::vector<vg::Graph> _graphs;
+   /** Set (or keep the lowest ranked) error for a path */
+   void addPathError(const std::string& name, int64_t rank,
+                     const std::string& error);
 
+   /** Edges stolen from the input chunks, stripped of the fields we
+    * never look at.  They are staged in a deque during loading then
+    * moved into _edges, sorted by source node, by buildAdjacency() */
+   std::deque<vg::Edge> _edgeStore;
+   std::vector<vg::Edge> _edges;
 
    /** Split out graph compoments into sets to (hopefully) handle merging. 
     * these are what we access during conversion */
-   NodeSet _nodes;
-   EdgeMap _fromEdges;
-   EdgeMap _toEdges;
+   NodeTable _nodes;
+   /** CSR adjacency: the edges leaving node table index i are 
+    * _outEdges[_outOffsets[i]] to _outEdges[_outOffsets[i+1]-1], and
+    * likewise for the edges entering it */
+   std::vector<size_t> _outOffsets;
+   std::vector<const vg::Edge*> _outEdges;
+   std::vector<size_t> _inOffsets;
+   std::vector<const vg::Edge*> _inEdges;
+   /** linear probing table of positions in _edges keyed on the whole
+    * edge (see hashEdge()), -1 is empty */
+   std::vector<int64_t> _edgeHash;
+   size_t _edgeHashMask;
+   /** paths as read (emptied by buildPaths()) */
+   std::map<std::string, RawPath> _rawPaths;
    PathMap _paths;
+   /** paths that can't be converted, along with rank and reason */
+   std::map<std::string, std::pair<int64_t, std::string> > _pathErrors;
    size_t _numEdges;
+   size_t _numThreads;
+   bool _hasPathFilter;
+   PathFilter _pathFilter;
+   std::map<std::string, bool> _pathFilterResults;
+   /** input id of each id after compactNodeIDs() (empty if not done) */
+   std::vector<int64_t> _originalIDs;
+   /** (input id, id) sorted by input id, for getCompactID() */
+   std::vector<std::pair<int64_t, int64_t> > _compactIDs;
 };
 
-inline bool VGLight::NodePtrLess::operator()(const vg::Node* node1,
-                                             const vg::Node* node2) const
+inline bool VGLight::RawStepRankLess::operator()(const RawStep& s1,
+                                                  const RawStep& s2) const
 {
-  return node1->id() < node2->id();
+  return s1._rank < s2._rank;
 }
 
-inline bool VGLight::MappingRankLess::operator()(const vg::Mapping& m1,
-                                                 const vg::Mapping& m2) const
+
+inline size_t VGLight::getNumThreads() const
 {
-  return m1.rank() < m2.rank();
+  return _numThreads;
 }
 
+inline bool VGLight::hasPathFilter() const
+{
+  return _hasPathFilter;
+}
 
-inline const VGLight::NodeSet& VGLight::getNodeSet() const
+inline bool VGLight::hasCompactIDs() const
 {
-  return _nodes;
+  return !_originalIDs.empty();
 }
 
-inline const VGLight::EdgeMap& VGLight::getFromEdgeMap() const
+inline int64_t VGLight::getOriginalID(int64_t id) const
 {
-  return _fromEdges;
+  if (_originalIDs.empty() || id < 0 || id >= (int64_t)_originalIDs.size())
+  {
+    return id;
+  }
+  return _originalIDs[id];
 }
 
-inline const VGLight::EdgeMap& VGLight::getToEdgeMap() const
+inline const NodeTable& VGLight::getNodeTable() const
 {
-  return _toEdges;
+  return _nodes;
 }
 
 inline size_t VGLight::getNumEdges() const
@@ -137,30 +387,75 @@ inline const VGLight::PathMap& VGLight::getPathMap() const
 
 inline const vg::Node* VGLight::getNode(int64_t id) const
 {
-  vg::Node node;
-  node.set_id(id);
-  NodeSet::const_iterator i = _nodes.find(&node);
-  return i != _nodes.end() ? *i : NULL;
+  return _nodes.find(id);
 }
 
-inline const vg::Edge* VGLight::getEdge(int64_t from_id, int64_t to_id,
-                                        bool from_start, bool to_end) const 
+inline size_t VGLight::hashEdge(int64_t from_id, int64_t to_id,
+                                bool from_start, bool to_end) const
 {
-  std::pair<EdgeMap::const_iterator, EdgeMap::const_iterator> ret =
-     _fromEdges.equal_range(from_id);
-  for (EdgeMap::const_iterator i = ret.first; i != ret.second; ++i)
+  uint64_t key = ((uint64_t)from_id << 2) | (from_start << 1) | to_end;
+  key = key * 0x9E3779B97F4A7C15ULL ^ (uint64_t)to_id * 0xC2B2AE3D27D4EB4FULL;
+  return (size_t)(key ^ (key >> 29)) & _edgeHashMask;
+}
+
+inline int64_t VGLight::getEdgeIndex(int64_t from_id, int64_t to_id,
+                                     bool from_start, bool to_end) const
+{
+  if (_edgeHash.empty())
+  {
+    return -1;
+  }
+  for (size_t i = hashEdge(from_id, to_id, from_start, to_end);
+       _edgeHash[i] != -1; i = (i + 1) & _edgeHashMask)
   {
-    if (i->second->to() == to_id &&
-        i->second->from_start() == from_start &&
-        i->second->to_end() == to_end)
+    const vg::Edge& edge = _edges[_edgeHash[i]];
+    if (edge.from() == from_id && edge.to() == to_id &&
+        edge.from_start() == from_start && edge.to_end() == to_end)
     {
-      return i->second;
+      return _edgeHash[i];
     }
   }
-  return NULL;
+  return -1;
+}
+
+inline int64_t VGLight::getEdgeIndex(const vg::Edge* edge) const
+{
+  return getEdgeIndex(edge->from(), edge->to(), edge->from_start(),
+                      edge->to_end());
+}
+
+inline const vg::Edge* VGLight::getEdge(int64_t from_id, int64_t to_id,
+                                        bool from_start, bool to_end) const 
+{
+  int64_t index = getEdgeIndex(from_id, to_id, from_start, to_end);
+  return index >= 0 ? &_edges[index] : NULL;
+}
+
+inline VGLight::EdgeSpan VGLight::getOutEdges(size_t nodeIndex) const
+{
+  assert(nodeIndex < _nodes.size());
+  return EdgeSpan(_outEdges.data() + _outOffsets[nodeIndex],
+                  _outEdges.data() + _outOffsets[nodeIndex + 1]);
+}
+
+inline VGLight::EdgeSpan VGLight::getInEdges(size_t nodeIndex) const
+{
+  assert(nodeIndex < _nodes.size());
+  return EdgeSpan(_inEdges.data() + _inOffsets[nodeIndex],
+                  _inEdges.data() + _inOffsets[nodeIndex + 1]);
+}
+
+inline VGLight::EdgeSpan VGLight::getOutEdges(const vg::Node* node) const
+{
+  return getOutEdges(_nodes.getIndex(node->id()));
+}
+
+inline VGLight::EdgeSpan VGLight::getInEdges(const vg::Node* node) const
+{
+  return getInEdges(_nodes.getIndex(node->id()));
 }
 
-inline const VGLight::MappingList& VGLight::getPath(const std::string& name)
+inline const VGLight::StepList& VGLight::getPath(const std::string& name)
   const
 {
   return _paths.find(name)->second;
@@ -170,6 +465,7 @@ inline void VGLight::removePath(const std::string& name)
 {
   assert(_paths.find(name) != _paths.end());
   _paths.erase(_paths.find(name));
+  _pathErrors.erase(name);
 }
 
 
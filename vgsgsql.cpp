@@ -5,6 +5,7 @@
  */
 #include "md5.h"
 #include "vgsgsql.h"
+#include "outputpipe.h"
 
 using namespace std;
 using namespace vg;
@@ -24,13 +25,46 @@ void VGSGSQL::exportGraph(const PathMapper* pm,
   _pm = pm;
   _halPath = vgPath;
 
-  writeDb(pm->getSideGraph(), sqlInsertPath, fastaPath);
+  // writeDb opens its outputs by name, so give it pipes that we copy
+  // to the real outputs (or stdout) with our own buffering
+  OutputPipe sqlPipe;
+  OutputPipe fastaPipe;
+  sqlPipe.open(sqlInsertPath);
+  fastaPipe.open(fastaPath);
+
+  // has to be set before the stream is opened to take effect
+  _outBuffer.resize(1 << 20);
+  _outStream.rdbuf()->pubsetbuf(&_outBuffer[0], _outBuffer.size());
+
+  // the pipes can't be finished while the SQL stream still has its
+  // one open, whether or not writeDb got to close it
+  try
+  {
+    writeDb(pm->getSideGraph(), sqlPipe.getPath(), fastaPipe.getPath());
+  }
+  catch(...)
+  {
+    if (_outStream.is_open())
+    {
+      _outStream.close();
+    }
+    throw;
+  }
+  if (_outStream.is_open())
+  {
+    _outStream.close();
+  }
+  sqlPipe.close();
+  fastaPipe.close();
 }
 
 void VGSGSQL::getSequenceString(const SGSequence* seq,
                                  string& outString) const
 {
-  outString = _pm->getSideGraphDNA(seq->getID());
+  // (straight from the path mapper's sequence data into a buffer that
+  // the writer reuses for every sequence)
+  outString.assign(_pm->getSideGraphDNAData(seq->getID()),
+                   _pm->getSideGraphDNALength(seq->getID()));
 }
 
 string VGSGSQL::getOriginName(const SGSequence* seq) const
@@ -32,7 +32,9 @@ public:
    VGSGSQL();
    virtual ~VGSGSQL();
 
-   /** write out the graph as a database 
+   /** write out the graph as a database.  either path can be "-"
+    * for stdout.  Both outputs go through an OutputPipe, so they are
+    * written in large blocks and stdout is never reopened
     */
    void exportGraph(const PathMapper* pm,
                     const std::string& sqlInsertPath,
@@ -67,6 +69,9 @@ protected:
 protected:
 
    const PathMapper* _pm;
+   /** big buffer for the SQL output, so it goes into its pipe in
+    * large writes */
+   std::vector<char> _outBuffer;
 };
 
 